@@ -24,26 +24,84 @@
 #define COMMON_ARRAY_FORMATTER_HPP
 
 #include "string_view.hpp"
+#include "number_format.hpp"
+#include "static_format.hpp"
 #include <array>
 
 namespace common
 {
 
-template <size_t Size>
-struct array_formatter
+namespace impl
 {
-    std::array<char, Size> buf {{'\0'}};
-    size_t bytes_remaining = Size;
 
-    array_formatter() = default;
-    array_formatter(const char* format_string, ...) __attribute__ ((format (printf, 2, 3)))
+/**
+ * The formatting operations shared by array_formatter and
+ * buffer_formatter, on top of Derived's formatv(), append_view()
+ * and remaining()/update_remaining().
+ */
+template <typename Derived>
+struct formatter_ops
+{
+    Derived& self() { return static_cast<Derived&>(*this); }
+
+    void format(const char* format_string, ...) __attribute__ ((format (printf, 2, 3)))
     {
         va_list args;
         va_start(args, format_string);
-        formatv(format_string, args);
+        self().formatv(format_string, args);
         va_end(args);
     }
-    void format(const char* format_string, ...) __attribute__ ((format (printf, 2, 3)))
+    /// Format from a compile-time checked COMMON_FMT() literal, see static_format()
+    template <typename Fmt, typename... Args, typename = decltype(Fmt::value())>
+    Derived& format(Fmt fmt, const Args&... args)
+    {
+        return common::static_format(self(), fmt, args...);
+    }
+
+    /**
+     * Typed appends, which skip vsnprintf() and its format parsing
+     * entirely.
+     *
+     *   fmt.append("took ").append(elapsed_ns).append("ns, ratio ").append(ratio, 3);
+     */
+    Derived& append(common::string_view str)
+    {
+        self().append_view(str);
+        return self();
+    }
+    Derived& append(char c)
+    {
+        return append(common::string_view{&c, 1});
+    }
+    Derived& append(const char* str)
+    {
+        return append(common::string_view{str});
+    }
+    template <typename T, typename = typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, char>::value && !std::is_same<T, bool>::value>::type>
+    Derived& append(T value)
+    {
+        return append(common::integer_chars(value).str());
+    }
+    Derived& append(double value, int precision = -1)
+    {
+        return append(common::double_chars(value, precision).str());
+    }
+    Derived& append_hex(uint64_t value, unsigned min_digits = 1)
+    {
+        return append(common::hex_chars(value, min_digits).str());
+    }
+};
+
+} // namespace impl
+
+template <size_t Size>
+struct array_formatter : impl::formatter_ops<array_formatter<Size>>
+{
+    std::array<char, Size> buf {{'\0'}};
+    size_t bytes_remaining = Size;
+
+    array_formatter() = default;
+    array_formatter(const char* format_string, ...) __attribute__ ((format (printf, 2, 3)))
     {
         va_list args;
         va_start(args, format_string);
@@ -54,6 +112,13 @@ struct array_formatter
     {
         update_remaining(remaining().formatv_advance(format, args));
     }
+    /// Like format(), truncates at the end of the buffer
+    void append_view(common::string_view str)
+    {
+        common::string_view_writeable rem = remaining().write_advance(str);
+        rem.data()[0] = '\0';
+        update_remaining(rem);
+    }
     void update_remaining(common::string_view_writeable rem)
     {
         bytes_remaining = rem.size() + 1;
@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_ASYNC_READER_HPP
+#define COMMON_ASYNC_READER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    define COMMON_HAVE_IO_URING 1
+#  endif
+#endif
+
+#include "common_result.hpp"
+#include "unix_err.hpp"
+#include "array_view.hpp"
+
+namespace common
+{
+
+struct read_request
+{
+    int fd;
+    uint64_t offset;
+    array_view<char> into;
+};
+
+namespace impl
+{
+
+#ifdef COMMON_HAVE_IO_URING
+/**
+ * A minimal io_uring on raw syscalls, just enough to
+ * keep a batch of IORING_OP_READs in flight.
+ */
+struct io_uring_queue
+{
+    enum : size_t { MAX_READ = 1 << 30 };
+
+    int ring_fd{-1};
+    unsigned entries{0};
+    void* sq_ring{nullptr};
+    size_t sq_ring_size{0};
+    void* cq_ring{nullptr};
+    size_t cq_ring_size{0};
+    io_uring_sqe* sqes{nullptr};
+
+    unsigned* sq_head{nullptr};
+    unsigned* sq_tail{nullptr};
+    unsigned* sq_mask{nullptr};
+    unsigned* sq_array{nullptr};
+    unsigned* cq_head{nullptr};
+    unsigned* cq_tail{nullptr};
+    unsigned* cq_mask{nullptr};
+    io_uring_cqe* cqes{nullptr};
+
+    io_uring_queue() = default;
+    io_uring_queue(const io_uring_queue&) = delete;
+    io_uring_queue& operator=(const io_uring_queue&) = delete;
+
+    result<ok, unix_err> init(unsigned queue_depth)
+    {
+        io_uring_params params;
+        ::memset(&params, 0, sizeof(params));
+        ring_fd = int(::syscall(__NR_io_uring_setup, queue_depth, &params));
+        if (ring_fd < 0)
+            return unix_err::current();
+        // IORING_OP_READ arrived alongside this feature (5.6)
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+            close();
+            return unix_err{ENOSYS};
+        }
+        entries = params.sq_entries;
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+        sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+            return fail();
+        cq_ring = single_mmap ? sq_ring : ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+            return fail();
+        void* sqe_map = ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqe_map == MAP_FAILED)
+            return fail();
+        sqes = static_cast<io_uring_sqe*>(sqe_map);
+
+        char* sq = static_cast<char*>(sq_ring);
+        sq_head  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cq_ring);
+        cq_head  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return ok{};
+    }
+    unix_err fail()
+    {
+        const unix_err err = unix_err::current();
+        close();
+        return err;
+    }
+
+    /// Queue a read of at most MAX_READ bytes, the caller keeps no more than entries in flight
+    void push_read(const read_request& req, uint64_t user_data)
+    {
+        const unsigned tail = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        ::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = req.fd;
+        sqe.off = req.offset;
+        sqe.addr = reinterpret_cast<uint64_t>(req.into.data());
+        sqe.len = unsigned(std::min<size_t>(req.into.size(), MAX_READ));
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    /**
+     * Submit up to to_submit queued reads, waiting for at least min_complete,
+     * and return how many were submitted: the rest stay queued for next time.
+     */
+    result<unsigned, unix_err> enter(unsigned to_submit, unsigned min_complete)
+    {
+        while (true) {
+            const long ret = ::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                                       min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (ret >= 0)
+                return unsigned(ret);
+            if (errno != EINTR)
+                return unix_err::current();
+        }
+    }
+    /// Drop queued reads the kernel has not consumed yet
+    void discard_unsubmitted()
+    {
+        __atomic_store_n(sq_tail, __atomic_load_n(sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+    /// fn(user_data, res) for each completion available
+    template <typename Fn>
+    unsigned reap(Fn&& fn)
+    {
+        unsigned head = *cq_head;
+        const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned reaped = 0;
+        for (; head != tail; ++head, ++reaped) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            fn(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return reaped;
+    }
+
+    void close()
+    {
+        if (sqes)
+            ::munmap(sqes, entries * sizeof(io_uring_sqe));
+        if (cq_ring && cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            ::munmap(cq_ring, cq_ring_size);
+        if (sq_ring && sq_ring != MAP_FAILED)
+            ::munmap(sq_ring, sq_ring_size);
+        if (ring_fd >= 0)
+            ::close(ring_fd);
+        ring_fd = -1;
+        sq_ring = cq_ring = nullptr;
+        sqes = nullptr;
+    }
+    ~io_uring_queue()
+    {
+        close();
+    }
+};
+#endif
+
+/**
+ * The pread() engine's worker threads, kept across batches: a batch
+ * queues its jobs and collects each completion as a worker posts it.
+ */
+struct read_pool
+{
+    struct job
+    {
+        read_request req;
+        size_t index;
+    };
+    struct completion
+    {
+        size_t index;
+        long res;
+    };
+
+    std::mutex lock;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    std::deque<job> jobs;
+    std::vector<completion> completed;
+    size_t running = 0;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    read_pool() = default;
+    read_pool(const read_pool&) = delete;
+    read_pool& operator=(const read_pool&) = delete;
+    ~read_pool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        work_ready.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    /// Grow to count workers, making do with fewer if threads run out
+    result<ok, unix_err> start(size_t count)
+    {
+        try {
+            while (threads.size() < count)
+                threads.emplace_back([this] { work(); });
+        } catch (const std::system_error& e) {
+            if (threads.empty())
+                return unix_err{e.code().value()};
+        }
+        return ok{};
+    }
+
+    /// Drop queued jobs and wait out running ones, so no read outlives its batch
+    void cancel()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        jobs.clear();
+        work_done.wait(guard, [this] { return running == 0; });
+        completed.clear();
+    }
+
+    /// pread() until into is full or end of file: bytes read, or -errno
+    static long read_fully(const read_request& req)
+    {
+        size_t done = 0;
+        while (done < req.into.size()) {
+            const ssize_t ret = ::pread(req.fd, req.into.data() + done, req.into.size() - done, off_t(req.offset + done));
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret < 0)
+                return -long(errno);
+            if (ret == 0)
+                break;
+            done += size_t(ret);
+        }
+        return long(done);
+    }
+
+private:
+    void work()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            work_ready.wait(guard, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            const job next = jobs.front();
+            jobs.pop_front();
+            running += 1;
+            guard.unlock();
+            const long res = read_fully(next.req);
+            guard.lock();
+            running -= 1;
+            completed.push_back(completion{next.index, res});
+            work_done.notify_all();
+        }
+    }
+};
+
+} // namespace impl
+
+/**
+ * Batched positional reads with many requests in flight:
+ * io_uring where the kernel supports it, otherwise pread()
+ * from a pool of worker threads started on first use.
+ *
+ *   async_reader reader;
+ *   reader.init();
+ *   reader.read_batch(requests, [&] (size_t index, result<array_view<char>, unix_err> res) { ... });
+ *
+ * Each result is the filled head of the request's buffer, which is
+ * shorter than requested only at end of file: short reads are retried.
+ */
+struct async_reader
+{
+    enum class engine
+    {
+        automatic,
+        io_uring,
+        threads,
+    };
+
+    unsigned queue_depth{0};
+    engine active{engine::threads};
+#ifdef COMMON_HAVE_IO_URING
+    impl::io_uring_queue ring;
+#endif
+    std::unique_ptr<impl::read_pool> pool;
+
+    /// Prefer io_uring under engine::automatic, falling back to threads
+    result<ok, unix_err> init(unsigned depth = 64, engine wanted = engine::automatic)
+    {
+        queue_depth = std::max(1u, depth);
+        active = engine::threads;
+        pool.reset();
+#ifdef COMMON_HAVE_IO_URING
+        ring.close();
+        if (wanted != engine::threads) {
+            auto res = ring.init(queue_depth);
+            if (res.is_ok()) {
+                active = engine::io_uring;
+                queue_depth = ring.entries;
+                return ok{};
+            }
+            if (wanted == engine::io_uring)
+                return res;
+        }
+#else
+        if (wanted == engine::io_uring)
+            return unix_err{ENOSYS};
+#endif
+        return ok{};
+    }
+
+    /**
+     * Read all requests, calling fn(index, result<array_view<char>, unix_err>)
+     * on this thread as each completes, in completion order.
+     * Only a failure of the engine itself is returned as an error.
+     */
+    template <typename Fn>
+    result<ok, unix_err> read_batch(array_view<const read_request> requests, Fn&& fn)
+    {
+        if (!queue_depth)
+            return unix_err{EINVAL};
+#ifdef COMMON_HAVE_IO_URING
+        if (active == engine::io_uring)
+            return read_batch_io_uring(requests, fn);
+#endif
+        return read_batch_threads(requests, fn);
+    }
+
+private:
+    static result<array_view<char>, unix_err> completion(const read_request& req, long res)
+    {
+        if (res < 0)
+            return unix_err{int(-res)};
+        return req.into.head(size_t(res));
+    }
+
+#ifdef COMMON_HAVE_IO_URING
+    /**
+     * Keeps up to queue_depth reads in flight. Short reads, and reads split
+     * at MAX_READ, are resubmitted for their remainder until end of file.
+     */
+    template <typename Fn>
+    result<ok, unix_err> read_batch_io_uring(array_view<const read_request> requests, Fn& fn)
+    {
+        std::vector<size_t> done(requests.size(), 0);
+        std::vector<size_t> resubmit;
+        size_t next = 0;
+        size_t finished = 0;
+        unsigned queued = 0;
+        unsigned in_flight = 0;
+        while (finished < requests.size()) {
+            while (queued + in_flight < queue_depth && (!resubmit.empty() || next < requests.size())) {
+                size_t index = next;
+                if (!resubmit.empty()) {
+                    index = resubmit.back();
+                    resubmit.pop_back();
+                } else {
+                    next += 1;
+                }
+                const read_request& req = requests[index];
+                ring.push_read(read_request{req.fd, req.offset + done[index], req.into.advance(done[index])}, index);
+                queued += 1;
+            }
+            // Only wait once something is known to be in flight, or a partial submit could block forever
+            auto submitted = ring.enter(queued, in_flight ? 1 : 0);
+            if (submitted.is_err()) {
+                abandon(in_flight);
+                return submitted.err();
+            }
+            queued -= submitted.res();
+            in_flight += submitted.res();
+            if (!in_flight) {
+                abandon(in_flight);
+                return unix_err{EBUSY};
+            }
+            in_flight -= ring.reap([&] (uint64_t index, int ret) {
+                const read_request& req = requests[index];
+                if (ret == -EINTR || ret == -EAGAIN) {
+                    resubmit.push_back(size_t(index));
+                    return;
+                }
+                if (ret > 0)
+                    done[index] += size_t(ret);
+                if (ret > 0 && done[index] < req.into.size()) {
+                    resubmit.push_back(size_t(index));
+                    return;
+                }
+                finished += 1;
+                if (ret < 0)
+                    fn(size_t(index), unix_err{-ret});
+                else
+                    fn(size_t(index), req.into.head(done[index]));
+            });
+        }
+        return ok{};
+    }
+
+    /**
+     * Leave no read behind on failure: unsubmitted ones are dropped and
+     * submitted ones waited for, so the kernel is done with the caller's
+     * buffers and no stale completion reaches a later batch. Should even
+     * waiting fail, the ring is closed and the thread engine takes over.
+     */
+    void abandon(unsigned in_flight)
+    {
+        ring.discard_unsubmitted();
+        while (in_flight) {
+            auto res = ring.enter(0, 1);
+            if (res.is_err() && res.err().unix_errno != EAGAIN && res.err().unix_errno != EBUSY) {
+                ring.close();
+                active = engine::threads;
+                return;
+            }
+            in_flight -= ring.reap([] (uint64_t, int) {});
+        }
+    }
+#endif
+
+    template <typename Fn>
+    result<ok, unix_err> read_batch_threads(array_view<const read_request> requests, Fn& fn)
+    {
+        if (!pool)
+            pool.reset(new impl::read_pool);
+        auto res = pool->start(queue_depth);
+        if (!res)
+            return res;
+
+        // Should fn throw, no worker may go on reading into the caller's buffers
+        struct cancel_on_exit
+        {
+            impl::read_pool& pool;
+            ~cancel_on_exit()
+            {
+                pool.cancel();
+            }
+        } cancel{*pool};
+        {
+            std::lock_guard<std::mutex> guard(pool->lock);
+            for (size_t i = 0; i < requests.size(); ++i)
+                pool->jobs.push_back(impl::read_pool::job{requests[i], i});
+        }
+        pool->work_ready.notify_all();
+
+        std::vector<impl::read_pool::completion> ready;
+        for (size_t delivered = 0; delivered < requests.size(); delivered += ready.size()) {
+            ready.clear();
+            {
+                std::unique_lock<std::mutex> guard(pool->lock);
+                pool->work_done.wait(guard, [this] { return !pool->completed.empty(); });
+                ready.swap(pool->completed);
+            }
+            for (const impl::read_pool::completion& done : ready)
+                fn(done.index, completion(requests[done.index], done.res));
+        }
+        return ok{};
+    }
+};
+
+} // namespace common
+
+#endif // COMMON_ASYNC_READER_HPP
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_ATOMIC_FILE_WRITER_HPP
+#define COMMON_ATOMIC_FILE_WRITER_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common_result.hpp"
+#include "unix_err.hpp"
+#include "fd_handle.hpp"
+
+namespace common
+{
+
+/**
+ * Replaces a file atomically: readers see either the old content or
+ * the complete new content, never a torn mix, even across a crash.
+ *
+ * Content goes to an anonymous O_TMPFILE (or a hidden temporary file
+ * where that is unsupported) in the target's directory, preallocated
+ * to the expected size and written in chunk-aligned blocks. commit()
+ * syncs the data, renames it over the target and, unless only
+ * atomicity is required, fsyncs the directory so the rename survives
+ * a crash too. Dropping the writer before commit() leaves the target
+ * untouched.
+ *
+ * Every stage returns its own unix_err; failed_stage records which
+ * stage failed last.
+ */
+struct atomic_file_writer
+{
+    enum class durability
+    {
+        atomic_only, ///< data synced and renamed, directory not synced
+        durable,     ///< also fsync() the directory, so the rename itself persists
+    };
+    enum class stage
+    {
+        none,
+        create,
+        preallocate,
+        write,
+        sync,
+        rename,
+        sync_directory,
+    };
+    enum { CHUNK_SIZE = 1 << 20 };
+
+    fd_handle file;
+    std::string target;
+    std::string temp_name; ///< empty while the temporary is anonymous
+    std::vector<char> chunk;
+    uint64_t written = 0;
+    stage failed_stage = stage::none;
+
+    atomic_file_writer() = default;
+    atomic_file_writer(const atomic_file_writer&) = delete;
+    atomic_file_writer& operator=(const atomic_file_writer&) = delete;
+    ~atomic_file_writer()
+    {
+        abort();
+    }
+
+    /// Start replacing target, reserving expected_size bytes up front if known
+    result<ok, unix_err> open(const char* target_name, uint64_t expected_size = 0, mode_t mode = 0644)
+    {
+        abort();
+        target = target_name;
+        written = 0;
+        chunk.clear();
+        chunk.reserve(CHUNK_SIZE);
+        failed_stage = stage::none;
+
+        const std::string dir = directory_of(target);
+        auto res = file.open(dir.c_str(), O_TMPFILE | O_WRONLY, mode);
+        // Like mkostemp(), the O_TMPFILE mode is masked by the umask: set it exactly
+        if (res && ::fchmod(file.fd(), mode) != 0)
+            return fail(stage::create, unix_err::current());
+        if (!res) {
+            const int err = res.err().unix_errno;
+            if (err != EOPNOTSUPP && err != EISDIR && err != EINVAL)
+                return fail(stage::create, res.err());
+            res = create_named(mode);
+            if (!res)
+                return fail(stage::create, res.err());
+        }
+        if (expected_size > 0 && ::fallocate(file.fd(), FALLOC_FL_KEEP_SIZE, 0, off_t(expected_size)) != 0) {
+            // Preallocation is only a hint where the filesystem cannot do it
+            if (errno != EOPNOTSUPP && errno != ENOSYS)
+                return fail(stage::preallocate, unix_err::current());
+        }
+        return ok{};
+    }
+
+    /// Append bytes, flushing in CHUNK_SIZE blocks
+    result<ok, unix_err> write(array_view<const char> bytes)
+    {
+        if (!file.good())
+            return fail(stage::write, unix_err{ENOENT});
+        if (!chunk.empty()) {
+            const size_t fill = std::min(bytes.size(), size_t(CHUNK_SIZE) - chunk.size());
+            chunk.insert(chunk.end(), bytes.begin(), bytes.begin() + fill);
+            bytes = bytes.advance(fill);
+            if (chunk.size() < CHUNK_SIZE)
+                return ok{};
+            auto res = flush_chunk();
+            if (!res)
+                return res;
+        }
+        // Whole chunks go straight from the caller's memory
+        const size_t direct = bytes.size() - bytes.size() % CHUNK_SIZE;
+        if (direct) {
+            auto res = file.write(bytes.head(direct));
+            if (!res)
+                return fail(stage::write, res.err());
+            written += direct;
+        }
+        chunk.insert(chunk.end(), bytes.begin() + direct, bytes.end());
+        return ok{};
+    }
+
+    /// Sync the content and move it over the target
+    result<ok, unix_err> commit(durability level = durability::durable)
+    {
+        if (!file.good())
+            return fail(stage::sync, unix_err{ENOENT});
+        auto res = flush_chunk();
+        if (!res)
+            return res;
+        res = file.datasync();
+        if (!res)
+            return fail(stage::sync, res.err());
+        if (temp_name.empty()) {
+            res = link_anonymous();
+            if (!res)
+                return fail(stage::rename, res.err());
+        }
+        if (::rename(temp_name.c_str(), target.c_str()) != 0)
+            return fail(stage::rename, unix_err::current());
+        temp_name.clear();
+        file.close();
+        if (level == durability::durable) {
+            res = sync_parent_directory(target.c_str());
+            if (!res)
+                return fail(stage::sync_directory, res.err());
+        }
+        return ok{};
+    }
+
+    /// Discard the new content, leaving the target as it was
+    void abort()
+    {
+        file.close();
+        if (!temp_name.empty()) {
+            ::unlink(temp_name.c_str());
+            temp_name.clear();
+        }
+    }
+
+private:
+    static std::string directory_of(const std::string& path)
+    {
+        const size_t slash = path.rfind('/');
+        if (slash == std::string::npos)
+            return ".";
+        if (slash == 0)
+            return "/";
+        return path.substr(0, slash);
+    }
+
+    /// Dot-prefixed so directory listings and globs skip it
+    std::string temp_prefix() const
+    {
+        const size_t slash = target.rfind('/');
+        const size_t base = (slash == std::string::npos) ? 0 : slash + 1;
+        return target.substr(0, base) + "." + target.substr(base) + ".tmp.";
+    }
+
+    result<ok, unix_err> fail(stage at, unix_err err)
+    {
+        failed_stage = at;
+        return err;
+    }
+
+    result<ok, unix_err> flush_chunk()
+    {
+        if (chunk.empty())
+            return ok{};
+        auto res = file.write(chunk);
+        if (!res)
+            return fail(stage::write, res.err());
+        written += chunk.size();
+        chunk.clear();
+        return ok{};
+    }
+
+    result<ok, unix_err> create_named(mode_t mode)
+    {
+        std::string name = temp_prefix() + "XXXXXX";
+        const int fd = ::mkostemp(&name[0], O_CLOEXEC);
+        if (fd < 0)
+            return unix_err::current();
+        file = fd_handle{fd};
+        temp_name = std::move(name);
+        if (::fchmod(fd, mode) != 0)
+            return unix_err::current();
+        return ok{};
+    }
+
+    /// Give the O_TMPFILE a name next to the target, ready for rename()
+    result<ok, unix_err> link_anonymous()
+    {
+        static std::atomic<unsigned> counter{0};
+        char proc_path[32];
+        snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", file.fd());
+        const std::string prefix = temp_prefix();
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            std::string name = prefix + std::to_string(::getpid()) + "." + std::to_string(counter++);
+            if (::linkat(AT_FDCWD, proc_path, AT_FDCWD, name.c_str(), AT_SYMLINK_FOLLOW) == 0) {
+                temp_name = std::move(name);
+                return ok{};
+            }
+            if (errno != EEXIST)
+                return unix_err::current();
+        }
+        return unix_err{EEXIST};
+    }
+};
+
+/// Replace target with content in one call
+inline result<ok, unix_err> write_file_atomic(const char* target, array_view<const char> content,
+        atomic_file_writer::durability level = atomic_file_writer::durability::durable)
+{
+    atomic_file_writer writer;
+    auto res = writer.open(target, content.size());
+    if (res)
+        res = writer.write(content);
+    if (res)
+        res = writer.commit(level);
+    return res;
+}
+
+} // namespace common
+
+#endif // COMMON_ATOMIC_FILE_WRITER_HPP
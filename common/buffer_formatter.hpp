@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_BUFFER_FORMATTER_HPP
+#define COMMON_BUFFER_FORMATTER_HPP
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "common/array_formatter.hpp"
+
+namespace common
+{
+
+/**
+ * A drop-in alternative to array_formatter which grows
+ * instead of truncating: it starts in an inline buffer of
+ * InlineSize, moves to the heap (growing geometrically) only
+ * when a message overflows, and keeps that capacity across
+ * clear(), so steady-state formatting does not allocate.
+ */
+template <size_t InlineSize = 256>
+struct buffer_formatter : impl::formatter_ops<buffer_formatter<InlineSize>>
+{
+    static_assert(InlineSize > 0, "the inline buffer needs room for the terminator");
+
+    std::array<char, InlineSize> inline_buf {{'\0'}};
+    std::vector<char> heap_buf;
+    size_t length = 0;
+
+    buffer_formatter() = default;
+    buffer_formatter(const char* format_string, ...) __attribute__ ((format (printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, format_string);
+        formatv(format_string, args);
+        va_end(args);
+    }
+
+    char* data() { return heap_buf.empty() ? inline_buf.data() : heap_buf.data(); }
+    const char* data() const { return heap_buf.empty() ? inline_buf.data() : heap_buf.data(); }
+    /// Including the terminator
+    size_t capacity() const { return heap_buf.empty() ? InlineSize : heap_buf.size(); }
+
+    void reserve(size_t bytes)
+    {
+        if (bytes <= capacity())
+            return;
+        std::vector<char> grown(std::max(bytes, capacity() * 2));
+        ::memcpy(grown.data(), data(), length + 1);
+        heap_buf.swap(grown);
+    }
+
+    /// vsnprintf() into the remaining space, growing and retrying once if it did not fit
+    void formatv(const char* const format, va_list args)
+    {
+        va_list retry;
+        va_copy(retry, args);
+        int ret = ::vsnprintf(data() + length, capacity() - length, format, args);
+        if (ret > 0 && size_t(ret) >= capacity() - length) {
+            reserve(length + ret + 1);
+            ret = ::vsnprintf(data() + length, capacity() - length, format, retry);
+        }
+        va_end(retry);
+        if (ret > 0)
+            length += std::min(size_t(ret), capacity() - length - 1);
+        data()[length] = '\0';
+    }
+    void append_view(common::string_view str)
+    {
+        reserve(length + str.size() + 1);
+        ::memcpy(data() + length, str.data(), str.size());
+        length += str.size();
+        data()[length] = '\0';
+    }
+    void update_remaining(common::string_view_writeable rem)
+    {
+        length = rem.data() - data();
+        data()[length] = '\0';
+    }
+    /// The currently allocated space after the text, excluding the terminator
+    common::string_view_writeable remaining()
+    {
+        return common::string_view_writeable{data() + length, capacity() - length - 1};
+    }
+
+    common::string_view str() const
+    {
+        return common::string_view{data(), length};
+    }
+    std::string to_string() const
+    {
+        return str().to_string();
+    }
+    const char* c_str() const
+    {
+        return data();
+    }
+    size_t size() const
+    {
+        return length;
+    }
+    /// Empties the text, keeping the capacity
+    void clear()
+    {
+        length = 0;
+        data()[0] = '\0';
+    }
+
+    operator common::string_view() const
+    {
+        return str();
+    }
+};
+
+} // namespace common
+
+#endif // COMMON_BUFFER_FORMATTER_HPP
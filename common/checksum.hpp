@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_CHECKSUM_HPP
+#define COMMON_CHECKSUM_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#include "array_view.hpp"
+
+#if !defined(COMMON_NO_SIMD) && defined(__SSE4_2__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define COMMON_SIMD_SSE42 1
+#endif
+
+namespace common
+{
+
+namespace impl
+{
+
+constexpr uint32_t CRC32C_POLY = 0x82F63B78u;
+
+inline uint64_t load_u64(const char* p)
+{
+    uint64_t v;
+    ::memcpy(&v, p, sizeof(v));
+    return v;
+}
+inline uint32_t load_u32(const char* p)
+{
+    uint32_t v;
+    ::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/// a * b modulo the CRC-32C polynomial, bit-reflected
+inline uint32_t crc32c_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m; m >>= 1) {
+        if (a & m)
+            product ^= b;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+/// x^(8 * bytes) modulo the polynomial: the effect of appending that many zero bytes
+inline uint32_t crc32c_zeros_factor(size_t bytes)
+{
+    uint32_t factor = 1u << 31;  // x^0
+    uint32_t square = 1u << 23;  // x^8
+    for (; bytes; bytes >>= 1) {
+        if (bytes & 1)
+            factor = crc32c_multiply(square, factor);
+        square = crc32c_multiply(square, square);
+    }
+    return factor;
+}
+
+/// Advances a raw crc register over a fixed count of zero bytes in four lookups
+struct crc32c_shift
+{
+    uint32_t table[4][256];
+
+    explicit crc32c_shift(size_t bytes)
+    {
+        const uint32_t factor = crc32c_zeros_factor(bytes);
+        for (uint32_t i = 0; i < 256; ++i)
+            for (int j = 0; j < 4; ++j)
+                table[j][i] = crc32c_multiply(factor, i << (8 * j));
+    }
+    uint32_t operator()(uint32_t crc) const
+    {
+        return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff]
+             ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+    }
+};
+
+/// Slicing-by-8 tables: table[k][b] is the crc of byte b followed by k zero bytes
+struct crc32c_tables
+{
+    uint32_t table[8][256];
+
+    crc32c_tables()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+            for (int k = 1; k < 8; ++k)
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+    }
+};
+
+inline const crc32c_tables& crc32c_table()
+{
+    static const crc32c_tables tables;
+    return tables;
+}
+
+/// Raw (non-inverted) crc register update, eight bytes per step
+inline uint32_t crc32c_sliced(uint32_t crc, const char* p, size_t size)
+{
+    const auto& t = crc32c_table().table;
+    for (; size && (uintptr_t(p) & 7); --size, ++p)
+        crc = t[0][(crc ^ uint8_t(*p)) & 0xff] ^ (crc >> 8);
+    for (; size >= 8; size -= 8, p += 8) {
+        const uint64_t word = load_u64(p) ^ crc;
+        crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff]
+            ^ t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff]
+            ^ t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff]
+            ^ t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+    }
+    for (; size; --size, ++p)
+        crc = t[0][(crc ^ uint8_t(*p)) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef COMMON_SIMD_SSE42
+/**
+ * The crc32 instruction has a latency of three cycles but a throughput
+ * of one per cycle, so run three independent streams over adjacent lanes
+ * and fold them together with a precomputed zero-byte shift.
+ */
+template <size_t Lane>
+inline uint32_t crc32c_interleaved(uint32_t crc, const char*& p, size_t& size)
+{
+    static const crc32c_shift shift{Lane};
+    while (size >= 3 * Lane) {
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+        for (size_t i = 0; i < Lane; i += 8) {
+            crc0 = _mm_crc32_u64(crc0, load_u64(p + i));
+            crc1 = _mm_crc32_u64(crc1, load_u64(p + Lane + i));
+            crc2 = _mm_crc32_u64(crc2, load_u64(p + 2 * Lane + i));
+        }
+        crc = shift(uint32_t(crc0)) ^ uint32_t(crc1);
+        crc = shift(crc) ^ uint32_t(crc2);
+        p += 3 * Lane;
+        size -= 3 * Lane;
+    }
+    return crc;
+}
+
+inline uint32_t crc32c_hardware(uint32_t crc, const char* p, size_t size)
+{
+    for (; size && (uintptr_t(p) & 7); --size, ++p)
+        crc = _mm_crc32_u8(crc, uint8_t(*p));
+    crc = crc32c_interleaved<8192>(crc, p, size);
+    crc = crc32c_interleaved<256>(crc, p, size);
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, p += 8)
+        crc64 = _mm_crc32_u64(crc64, load_u64(p));
+    crc = uint32_t(crc64);
+    for (; size; --size, ++p)
+        crc = _mm_crc32_u8(crc, uint8_t(*p));
+    return crc;
+}
+#endif
+
+inline uint32_t crc32c_update(uint32_t crc, const char* p, size_t size)
+{
+#ifdef COMMON_SIMD_SSE42
+    return crc32c_hardware(crc, p, size);
+#else
+    return crc32c_sliced(crc, p, size);
+#endif
+}
+
+constexpr uint64_t XXH_PRIME1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t XXH_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t XXH_PRIME3 = 0x165667B19E3779F9ull;
+constexpr uint64_t XXH_PRIME4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t XXH_PRIME5 = 0x27D4EB2F165667C5ull;
+
+constexpr uint64_t rotl64(uint64_t v, int bits)
+{
+    return (v << bits) | (v >> (64 - bits));
+}
+constexpr uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    return rotl64(acc + input * XXH_PRIME2, 31) * XXH_PRIME1;
+}
+constexpr uint64_t xxh64_merge(uint64_t acc, uint64_t v)
+{
+    return (acc ^ xxh64_round(0, v)) * XXH_PRIME1 + XXH_PRIME4;
+}
+
+inline uint64_t xxh64_finish(uint64_t h, const char* p, size_t size)
+{
+    for (; size >= 8; size -= 8, p += 8)
+        h = rotl64(h ^ xxh64_round(0, load_u64(p)), 27) * XXH_PRIME1 + XXH_PRIME4;
+    if (size >= 4) {
+        h = rotl64(h ^ (load_u32(p) * XXH_PRIME1), 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+        size -= 4;
+    }
+    for (; size; --size, ++p)
+        h = rotl64(h ^ (uint8_t(*p) * XXH_PRIME5), 11) * XXH_PRIME1;
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace impl
+
+/**
+ * CRC-32C (Castagnoli), as used by iSCSI, ext4 and most storage
+ * formats. Pass a previous result as crc to continue over more data.
+ * Uses the SSE4.2 crc32 instruction when compiled for it, otherwise
+ * slicing-by-8 tables.
+ */
+inline uint32_t crc32c(array_view<const char> bytes, uint32_t crc = 0)
+{
+    return ~impl::crc32c_update(~crc, bytes.data(), bytes.size());
+}
+
+/// Streaming CRC-32C, for data that arrives in pieces
+struct crc32c_state
+{
+    uint32_t value = 0;
+
+    void update(array_view<const char> bytes)
+    {
+        value = crc32c(bytes, value);
+    }
+    uint32_t digest() const
+    {
+        return value;
+    }
+};
+
+/// Streaming XXH64, a fast non-cryptographic 64-bit hash
+struct xxhash64_state
+{
+    enum { STRIPE = 32 };
+
+    uint64_t seed;
+    uint64_t acc[4];
+    uint64_t total = 0;
+    char buffer[STRIPE];
+    size_t buffered = 0;
+
+    explicit xxhash64_state(uint64_t seed = 0)
+        : seed(seed)
+        , acc{seed + impl::XXH_PRIME1 + impl::XXH_PRIME2, seed + impl::XXH_PRIME2, seed, seed - impl::XXH_PRIME1}
+    {
+    }
+
+    void update(array_view<const char> bytes)
+    {
+        const char* p = bytes.data();
+        size_t size = bytes.size();
+        total += size;
+        if (buffered) {
+            const size_t fill = std::min(size, size_t(STRIPE) - buffered);
+            ::memcpy(buffer + buffered, p, fill);
+            buffered += fill;
+            p += fill;
+            size -= fill;
+            if (buffered < STRIPE)
+                return;
+            consume_stripe(buffer);
+            buffered = 0;
+        }
+        for (; size >= STRIPE; size -= STRIPE, p += STRIPE)
+            consume_stripe(p);
+        if (size)
+            ::memcpy(buffer, p, size);
+        buffered = size;
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t h;
+        if (total >= STRIPE) {
+            h = impl::rotl64(acc[0], 1) + impl::rotl64(acc[1], 7) + impl::rotl64(acc[2], 12) + impl::rotl64(acc[3], 18);
+            for (uint64_t a : acc)
+                h = impl::xxh64_merge(h, a);
+        } else {
+            h = seed + impl::XXH_PRIME5;
+        }
+        return impl::xxh64_finish(h + total, buffer, buffered);
+    }
+
+private:
+    void consume_stripe(const char* p)
+    {
+        for (int i = 0; i < 4; ++i)
+            acc[i] = impl::xxh64_round(acc[i], impl::load_u64(p + 8 * i));
+    }
+};
+
+/// XXH64 of bytes in one call
+inline uint64_t xxhash64(array_view<const char> bytes, uint64_t seed = 0)
+{
+    xxhash64_state state{seed};
+    state.update(bytes);
+    return state.digest();
+}
+
+} // namespace common
+
+#endif // COMMON_CHECKSUM_HPP
@@ -23,12 +23,64 @@
 #ifndef COMMON_TIMESTAMP_HPP
 #define COMMON_TIMESTAMP_HPP
 
+#include <algorithm>
 #include <cstdint>
 #include <chrono>
+#include <ctime>
+#include <limits>
+#include <type_traits>
+
+#include "array_view.hpp"
 
 namespace common
 {
 
+/**
+ * A signed interval in integer nanoseconds: exact where the
+ * double-based timestamp arithmetic loses precision at epoch scale.
+ */
+struct duration
+{
+    int64_t ns = 0;
+
+    constexpr duration() = default;
+    constexpr explicit duration(int64_t nanos) : ns(nanos) {}
+    template <typename Rep, typename Period>
+    constexpr duration(std::chrono::duration<Rep, Period> dur) : ns(std::chrono::duration_cast<std::chrono::nanoseconds>(dur).count()) {}
+
+    static constexpr duration nanoseconds(int64_t n) { return duration{n}; }
+    static constexpr duration microseconds(int64_t n) { return duration{n * 1000}; }
+    static constexpr duration milliseconds(int64_t n) { return duration{n * 1000 * 1000}; }
+    static constexpr duration seconds(int64_t n) { return duration{n * 1000 * 1000 * 1000}; }
+    static constexpr duration from_double(double s) { return duration{int64_t(s * 1e9)}; }
+
+    constexpr int64_t to_nanos() const { return ns; }
+    constexpr int64_t to_micros() const { return ns / 1000; }
+    constexpr int64_t to_millis() const { return ns / (1000 * 1000); }
+    constexpr int64_t to_seconds() const { return ns / (1000 * 1000 * 1000); }
+    constexpr double to_double() const { return ns * 1e-9; }
+    constexpr std::chrono::nanoseconds to_chrono() const { return std::chrono::nanoseconds{ns}; }
+    /// Seconds, for code written when timestamp subtraction returned a double
+    constexpr explicit operator double() const { return to_double(); }
+
+    constexpr bool operator<(const duration& other) const { return ns < other.ns; }
+    constexpr bool operator<=(const duration& other) const { return ns <= other.ns; }
+    constexpr bool operator>(const duration& other) const { return ns > other.ns; }
+    constexpr bool operator>=(const duration& other) const { return ns >= other.ns; }
+    constexpr bool operator==(const duration& other) const { return ns == other.ns; }
+    constexpr bool operator!=(const duration& other) const { return ns != other.ns; }
+
+    constexpr duration operator-() const { return duration{-ns}; }
+    constexpr duration operator+(const duration& other) const { return duration{ns + other.ns}; }
+    constexpr duration operator-(const duration& other) const { return duration{ns - other.ns}; }
+    constexpr duration operator*(int64_t factor) const { return duration{ns * factor}; }
+    constexpr duration operator/(int64_t divisor) const { return duration{ns / divisor}; }
+    constexpr int64_t operator/(const duration& other) const { return ns / other.ns; }
+    constexpr duration operator%(const duration& other) const { return duration{ns % other.ns}; }
+    duration& operator+=(const duration& other) { ns += other.ns; return *this; }
+    duration& operator-=(const duration& other) { ns -= other.ns; return *this; }
+};
+
 struct timestamp
 {
     enum { SEC_NS = 1 * 1000 * 1000 * 1000 };
@@ -47,26 +99,29 @@ struct timestamp
     constexpr static timestamp zero() { return timestamp(); }
     constexpr explicit operator bool() const { return secs || nsecs; }
 
-    constexpr bool operator>(const timestamp& other) const { return (secs > other.secs) || ( (secs == other.secs) && (nsecs > other.nsecs) ); }
-    constexpr bool operator>=(const timestamp& other) const { return (secs > other.secs) || ( (secs == other.secs) && (nsecs >= other.nsecs) ); }
-    constexpr bool operator<(const timestamp& other) const { return (secs < other.secs) || ( (secs == other.secs) && (nsecs < other.nsecs) ); }
-    constexpr bool operator<=(const timestamp& other) const { return (secs < other.secs) || ( (secs == other.secs) && (nsecs <= other.nsecs) ); }
-    constexpr bool operator==(const timestamp& other) const { return (secs == other.secs) && (nsecs == other.nsecs); }
-    constexpr bool operator!=(const timestamp& other) const { return (secs != other.secs) || (nsecs != other.nsecs); }
+    /// Nanoseconds since the epoch: one integer, so ordering is a single compare
+    constexpr uint64_t to_nanos() const { return uint64_t(secs) * SEC_NS + nsecs; }
 
-    constexpr double operator-(const timestamp& other) const { return to_double() - other.to_double(); }
-    timestamp operator+(const timestamp& other) const
-    {
-        common::timestamp ret{secs + other.secs, nsecs + other.nsecs};
-        if (ret.nsecs >= SEC_NS) {
-            ret.secs += ret.nsecs / SEC_NS;
-            ret.nsecs = ret.nsecs % SEC_NS;
-        }
-        return ret;
-    }
+    constexpr bool operator>(const timestamp& other) const { return to_nanos() > other.to_nanos(); }
+    constexpr bool operator>=(const timestamp& other) const { return to_nanos() >= other.to_nanos(); }
+    constexpr bool operator<(const timestamp& other) const { return to_nanos() < other.to_nanos(); }
+    constexpr bool operator<=(const timestamp& other) const { return to_nanos() <= other.to_nanos(); }
+    constexpr bool operator==(const timestamp& other) const { return to_nanos() == other.to_nanos(); }
+    constexpr bool operator!=(const timestamp& other) const { return to_nanos() != other.to_nanos(); }
+
+    /// The exact interval between two stamps (this used to be a double of seconds)
+    constexpr duration operator-(const timestamp& other) const { return duration{int64_t(to_nanos() - other.to_nanos())}; }
+    /// Seconds from other to this, the double that operator- used to return
+    constexpr double seconds_since(const timestamp& other) const { return (*this - other).to_double(); }
+    /// Shifts by an interval; the result must not precede the epoch
+    constexpr timestamp operator+(const duration& dur) const { return from_nanos(to_nanos() + uint64_t(dur.ns)); }
+    constexpr timestamp operator-(const duration& dur) const { return from_nanos(to_nanos() - uint64_t(dur.ns)); }
+    timestamp& operator+=(const duration& dur) { return *this = *this + dur; }
+    timestamp& operator-=(const duration& dur) { return *this = *this - dur; }
+    constexpr timestamp operator+(const timestamp& other) const { return from_nanos(to_nanos() + other.to_nanos()); }
     constexpr timestamp minus_seconds(double secs) const
     {
-        return timestamp{*this - timestamp{secs}};
+        return *this - duration::from_double(secs);
     }
 
     static timestamp now()
@@ -74,6 +129,45 @@ struct timestamp
         const auto now = std::chrono::system_clock::now();
         return from_chrono_duration(now.time_since_epoch());
     }
+    /// Time since an arbitrary start (usually boot), immune to NTP steps: for measuring intervals
+    static timestamp monotonic_now()
+    {
+        return from_clock(CLOCK_MONOTONIC);
+    }
+    /// Wall-clock time as of the last scheduler tick (a few ms resolution), several times cheaper than now()
+    static timestamp coarse_now()
+    {
+#ifdef CLOCK_REALTIME_COARSE
+        return from_clock(CLOCK_REALTIME_COARSE);
+#else
+        return from_clock(CLOCK_REALTIME);
+#endif
+    }
+    /// monotonic_now() at tick resolution, for cheap timeouts and latency buckets
+    static timestamp monotonic_coarse_now()
+    {
+#ifdef CLOCK_MONOTONIC_COARSE
+        return from_clock(CLOCK_MONOTONIC_COARSE);
+#else
+        return from_clock(CLOCK_MONOTONIC);
+#endif
+    }
+    /// std::chrono::steady_clock, for portability where clock_gettime() is unavailable
+    static timestamp steady_now()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        return from_chrono_duration(now.time_since_epoch());
+    }
+    static timestamp from_clock(clockid_t clock)
+    {
+        struct timespec ts;
+        ::clock_gettime(clock, &ts);
+        return from_timespec(ts);
+    }
+    static constexpr timestamp from_timespec(const struct timespec& ts)
+    {
+        return timestamp{uint32_t(ts.tv_sec), uint32_t(ts.tv_nsec)};
+    }
     template <typename T>
     constexpr static timestamp cvt(const T& t)
     {
@@ -89,6 +183,58 @@ struct timestamp
     }
 };
 
+/**
+ * A timestamp packed into one signed count of nanoseconds since the
+ * epoch, for dense time-series storage: ordering is one integer
+ * compare, and arrays of them sort and vectorise like plain integers.
+ * Converts losslessly to and from timestamp (for non-negative values).
+ */
+struct timestamp_ns
+{
+    int64_t ns = 0;
+
+    constexpr timestamp_ns() = default;
+    constexpr explicit timestamp_ns(int64_t nanos) : ns(nanos) {}
+    constexpr timestamp_ns(const timestamp& t) : ns(int64_t(t.to_nanos())) {}
+    constexpr timestamp to_timestamp() const { return timestamp::from_nanos(uint64_t(ns)); }
+    static timestamp_ns now() { return timestamp_ns{timestamp::now()}; }
+
+    constexpr bool operator<(const timestamp_ns& other) const { return ns < other.ns; }
+    constexpr bool operator<=(const timestamp_ns& other) const { return ns <= other.ns; }
+    constexpr bool operator>(const timestamp_ns& other) const { return ns > other.ns; }
+    constexpr bool operator>=(const timestamp_ns& other) const { return ns >= other.ns; }
+    constexpr bool operator==(const timestamp_ns& other) const { return ns == other.ns; }
+    constexpr bool operator!=(const timestamp_ns& other) const { return ns != other.ns; }
+
+    constexpr duration operator-(const timestamp_ns& other) const { return duration{ns - other.ns}; }
+    constexpr timestamp_ns operator+(const duration& dur) const { return timestamp_ns{ns + dur.ns}; }
+    constexpr timestamp_ns operator-(const duration& dur) const { return timestamp_ns{ns - dur.ns}; }
+};
+static_assert(sizeof(timestamp_ns) == sizeof(int64_t) && std::is_trivially_copyable<timestamp_ns>::value,
+        "timestamp_ns must stay a bare integer");
+
+/// Pack timestamps into out, returning the count converted (the shorter of the two)
+inline size_t pack_timestamps(array_view<const timestamp> in, array_view<timestamp_ns> out)
+{
+    const size_t count = std::min(in.size(), out.size());
+    const timestamp* src = in.data();
+    timestamp_ns* dst = out.data();
+    for (size_t i = 0; i < count; ++i)
+        dst[i].ns = int64_t(src[i].to_nanos());
+    return count;
+}
+
+/// Unpack timestamp_ns values into out, returning the count converted
+inline size_t unpack_timestamps(array_view<const timestamp_ns> in, array_view<timestamp> out)
+{
+    const size_t count = std::min(in.size(), out.size());
+    const timestamp_ns* src = in.data();
+    timestamp* dst = out.data();
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = src[i].to_timestamp();
+    return count;
+}
+
 } // namespace common
 
 #endif // COMMON_TIMESTAMP_HPP
@@ -23,7 +23,12 @@
 #ifndef COMMON_TIMESTAMP_FMT_HPP
 #define COMMON_TIMESTAMP_FMT_HPP
 
+#include <cstring>
 #include <ctime>
+#include "common/common_timestamp.hpp"
+#include "common/common_result.hpp"
+#include "common/number_format.hpp"
+#include "common/string_parse.hpp"
 #include "common/string_view.hpp"
 
 namespace common
@@ -43,6 +48,226 @@ inline common::string_view timestamp_fmt_str(array_view<char> to, const char* st
     return common::string_view{to}.head(bytes);
 }
 
+namespace impl
+{
+
+struct civil_date
+{
+    int32_t year;
+    uint32_t month; ///< 1..12
+    uint32_t day;   ///< 1..31
+};
+
+/// The proleptic Gregorian date of a count of days since 1970-01-01
+inline civil_date civil_from_days(int64_t days)
+{
+    // Howard Hinnant's algorithm: count in 400-year eras starting from March 0000
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const uint32_t day_of_era = uint32_t(days - era * 146097);
+    const uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const uint32_t month_from_march = (5 * day_of_year + 2) / 153;
+    const uint32_t day = day_of_year - (153 * month_from_march + 2) / 5 + 1;
+    const uint32_t month = month_from_march < 10 ? month_from_march + 3 : month_from_march - 9;
+    return civil_date{int32_t(year_of_era + era * 400 + (month <= 2)), month, day};
+}
+
+/// Days since 1970-01-01 of a proleptic Gregorian date, the inverse of civil_from_days()
+inline int64_t days_from_civil(int32_t year, uint32_t month, uint32_t day)
+{
+    year -= (month <= 2);
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const uint32_t year_of_era = uint32_t(year - era * 400);
+    const uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + int64_t(day_of_era) - 719468;
+}
+
+inline uint32_t days_in_month(int32_t year, uint32_t month)
+{
+    static const uint8_t days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    const bool leap = (year % 4 == 0) && ((year % 100 != 0) || (year % 400 == 0));
+    return days[month - 1] + (month == 2 && leap);
+}
+
+struct iso8601_fields
+{
+    int32_t year;
+    uint32_t month, day, hour, minute, second;
+};
+
+/**
+ * Validates and reads the fixed-position "YYYY-MM-DDTHH:MM:SS" at p
+ * (19 readable bytes), accepting 't' or ' ' for the 'T'.
+ */
+inline bool parse_iso8601_fields(const char* p, iso8601_fields& out)
+{
+    const char t = p[10];
+    if (t != 'T' && t != 't' && t != ' ')
+        return false;
+#ifdef COMMON_PARSE_SWAR
+    // Three overlapping loads: "YYYY-MM-", "DDTHH:MM" and "HH:MM:SS"
+    const uint64_t date = load_eight(p);
+    const uint64_t time = load_eight(p + 8);
+    const uint64_t secs = load_eight(p + 11);
+    auto digits_at = [] (uint64_t v, uint64_t mask) {
+        const uint64_t high = 0xF0F0F0F0F0F0F0F0ull & mask;
+        const uint64_t zeros = 0x3030303030303030ull & mask;
+        return ((v & high) == zeros) && (((v + 0x0606060606060606ull) & high) == zeros);
+    };
+    if (!digits_at(date, 0x00FFFF00FFFFFFFFull) || (date & 0xFF0000FF00000000ull) != 0x2D00002D00000000ull
+            || !digits_at(time, 0xFFFF00FFFF00FFFFull) || (time & 0x0000FF0000000000ull) != 0x00003A0000000000ull
+            || !digits_at(secs, 0xFFFF000000000000ull) || (secs & 0x0000FF0000000000ull) != 0x00003A0000000000ull)
+        return false;
+#else
+    static const char pattern[] = "dddd-dd-ddTdd:dd:dd";
+    for (int i = 0; i < 19; ++i) {
+        if (pattern[i] == 'd' ? !is_digit(p[i]) : (i != 10 && p[i] != pattern[i]))
+            return false;
+    }
+#endif
+    auto two = [p] (int at) { return uint32_t(p[at] - '0') * 10 + uint32_t(p[at + 1] - '0'); };
+    out.year = int32_t(two(0) * 100 + two(2));
+    out.month = two(5);
+    out.day = two(8);
+    out.hour = two(11);
+    out.minute = two(14);
+    out.second = two(17);
+    return true;
+}
+
+inline void write_two_digits(char* to, uint32_t value)
+{
+    ::memcpy(to, digit_pairs() + value * 2, 2);
+}
+
+/// "YYYY-MM-DDTHH:MM:SS" for secs, 19 characters
+inline void write_iso8601_seconds(char* to, uint32_t secs)
+{
+    const civil_date date = civil_from_days(secs / 86400);
+    const uint32_t of_day = secs % 86400;
+    write_two_digits(to, uint32_t(date.year) / 100);
+    write_two_digits(to + 2, uint32_t(date.year) % 100);
+    to[4] = '-';
+    write_two_digits(to + 5, date.month);
+    to[7] = '-';
+    write_two_digits(to + 8, date.day);
+    to[10] = 'T';
+    write_two_digits(to + 11, of_day / 3600);
+    to[13] = ':';
+    write_two_digits(to + 14, of_day / 60 % 60);
+    to[16] = ':';
+    write_two_digits(to + 17, of_day % 60);
+}
+
+} // namespace impl
+
+enum { ISO8601_SECONDS_SIZE = 19, ISO8601_SIZE = 30 };
+
+/**
+ * Writes stamp as "YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ" (ISO8601_SIZE
+ * characters, not terminated) and returns the length, or 0 when to
+ * is too small. The date and time of day are cached per thread, so
+ * stamps within the same second only format their nanoseconds.
+ */
+inline size_t timestamp_fmt_iso8601(array_view<char> to, common::timestamp stamp)
+{
+    if (to.size() < ISO8601_SIZE)
+        return 0;
+    struct second_cache
+    {
+        uint32_t secs = 0;
+        char prefix[ISO8601_SECONDS_SIZE];
+        second_cache() { impl::write_iso8601_seconds(prefix, 0); }
+    };
+    thread_local second_cache cache;
+    if (cache.secs != stamp.secs) {
+        impl::write_iso8601_seconds(cache.prefix, stamp.secs);
+        cache.secs = stamp.secs;
+    }
+    char* out = to.data();
+    ::memcpy(out, cache.prefix, ISO8601_SECONDS_SIZE);
+    out[19] = '.';
+    const uint32_t nsecs = stamp.nsecs % timestamp::SEC_NS;
+    out[20] = char('0' + nsecs / 100000000);
+    impl::write_two_digits(out + 21, nsecs / 1000000 % 100);
+    impl::write_two_digits(out + 23, nsecs / 10000 % 100);
+    impl::write_two_digits(out + 25, nsecs / 100 % 100);
+    impl::write_two_digits(out + 27, nsecs % 100);
+    out[29] = 'Z';
+    return ISO8601_SIZE;
+}
+
+inline common::string_view timestamp_fmt_iso8601_str(array_view<char> to, common::timestamp stamp)
+{
+    const size_t bytes = timestamp_fmt_iso8601(to, stamp);
+    return common::string_view{to}.head(bytes);
+}
+
+/**
+ * Parses an RFC 3339 timestamp, "YYYY-MM-DDTHH:MM:SS[.fraction](Z|+HH:MM|-HH:MM)",
+ * without allocating or consulting the locale. Fractions beyond nanoseconds
+ * are truncated, and a leap second of :60 folds into the following second.
+ * Times before the epoch or past timestamp::max_value() are out_of_range.
+ */
+inline result<common::timestamp, parse_error> parse_timestamp(string_view str)
+{
+    if (str.empty())
+        return parse_error::empty;
+    // The shortest form is "YYYY-MM-DDTHH:MM:SSZ"
+    if (str.size() < 20)
+        return parse_error::invalid;
+    const char* p = str.data();
+    const char* const end = p + str.size();
+
+    impl::iso8601_fields f;
+    if (!impl::parse_iso8601_fields(p, f))
+        return parse_error::invalid;
+    if (f.month < 1 || f.month > 12 || f.day < 1 || f.day > impl::days_in_month(f.year, f.month)
+            || f.hour > 23 || f.minute > 59 || f.second > 60)
+        return parse_error::invalid;
+    p += 19;
+
+    uint32_t nsecs = 0;
+    if (*p == '.') {
+        ++p;
+        uint64_t fraction = 0;
+        const char* digits_end = impl::parse_digits(p, end, fraction, 9);
+        const size_t digits = size_t(digits_end - p);
+        if (digits == 0)
+            return parse_error::invalid;
+        static const uint32_t scale[] = {1, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1};
+        nsecs = uint32_t(fraction) * scale[digits];
+        p = digits_end;
+        while (p != end && impl::is_digit(*p))
+            ++p;
+    }
+
+    int64_t offset_secs = 0;
+    if (p != end && (*p == 'Z' || *p == 'z')) {
+        ++p;
+    } else if (end - p == 6 && (*p == '+' || *p == '-') && p[3] == ':'
+            && impl::is_digit(p[1]) && impl::is_digit(p[2]) && impl::is_digit(p[4]) && impl::is_digit(p[5])) {
+        const uint32_t hours = uint32_t(p[1] - '0') * 10 + uint32_t(p[2] - '0');
+        const uint32_t minutes = uint32_t(p[4] - '0') * 10 + uint32_t(p[5] - '0');
+        if (hours > 23 || minutes > 59)
+            return parse_error::invalid;
+        offset_secs = int64_t(hours * 3600 + minutes * 60) * (*p == '-' ? -1 : 1);
+        p += 6;
+    } else {
+        return parse_error::invalid;
+    }
+    if (p != end)
+        return parse_error::invalid;
+
+    const int64_t secs = impl::days_from_civil(f.year, f.month, f.day) * 86400
+                       + int64_t(f.hour * 3600 + f.minute * 60 + f.second) - offset_secs;
+    if (secs < 0 || secs > int64_t(std::numeric_limits<uint32_t>::max()))
+        return parse_error::out_of_range;
+    return common::timestamp{uint32_t(secs), nsecs};
+}
+
 } // namespace common
 
 #endif // COMMON_TIMESTAMP_FMT_HPP
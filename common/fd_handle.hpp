@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_FD_HANDLE_HPP
+#define COMMON_FD_HANDLE_HPP
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string>
+#include <utility>
+
+#include "common_result.hpp"
+#include "unix_err.hpp"
+#include "array_view.hpp"
+
+namespace common
+{
+
+namespace impl
+{
+
+/**
+ * Writes all of parts through write_fn(iovecs, count, bytes_written_so_far),
+ * a writev()-like call, resuming after partial writes and EINTR.
+ * A call that writes nothing fails with EIO.
+ */
+template <typename WriteFn>
+result<ok, unix_err> write_vectored(array_view<const array_view<const char>> parts, WriteFn&& write_fn)
+{
+    enum { BATCH = 64 };
+    size_t part = 0;
+    size_t part_offset = 0;
+    uint64_t written = 0;
+    while (true) {
+        while (part < parts.size() && part_offset == parts[part].size()) {
+            part += 1;
+            part_offset = 0;
+        }
+        if (part == parts.size())
+            return ok{};
+
+        struct iovec iov[BATCH];
+        int count = 0;
+        for (size_t i = part; i < parts.size() && count < BATCH; ++i) {
+            const size_t skip = (i == part) ? part_offset : 0;
+            if (parts[i].size() == skip)
+                continue;
+            iov[count].iov_base = const_cast<char*>(parts[i].data() + skip);
+            iov[count].iov_len = parts[i].size() - skip;
+            count += 1;
+        }
+        const ssize_t ret = write_fn(iov, count, written);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return unix_err::current();
+        }
+        // Only non-empty parts are queued, so 0 means no progress
+        if (ret == 0)
+            return unix_err{EIO};
+        written += ret;
+        for (size_t left = ret; left; ) {
+            const size_t available = parts[part].size() - part_offset;
+            if (left < available) {
+                part_offset += left;
+                break;
+            }
+            left -= available;
+            part += 1;
+            part_offset = 0;
+        }
+    }
+}
+
+inline result<ok, unix_err> fadvise(int fd, uint64_t offset, uint64_t bytes, int advice)
+{
+    // Only called by handles, where -1 means not open
+    if (fd < 0)
+        return unix_err{ENOENT};
+    // posix_fadvise() returns the error rather than setting errno
+    const int err = ::posix_fadvise(fd, off_t(offset), off_t(bytes), advice);
+    if (err != 0)
+        return unix_err{err};
+    return ok{};
+}
+
+inline result<ok, unix_err> readahead(int fd, uint64_t offset, uint64_t bytes)
+{
+    if (fd < 0)
+        return unix_err{ENOENT};
+    // Unlike posix_fadvise(), readahead(2) reads nothing for a count of 0
+    if (bytes == 0) {
+        struct stat stat_buf;
+        if (::fstat(fd, &stat_buf) != 0)
+            return unix_err::current();
+        if (uint64_t(stat_buf.st_size) <= offset)
+            return ok{};
+        bytes = uint64_t(stat_buf.st_size) - offset;
+    }
+    if (::readahead(fd, off64_t(offset), size_t(bytes)) != 0)
+        return unix_err::current();
+    return ok{};
+}
+
+} // namespace impl
+
+/**
+ * A trivial RAII file descriptor wrapper, the unbuffered
+ * sibling of file_handle.
+ *
+ * The positional read_at()/write_at() calls share no
+ * state, so any number of threads may use them on the
+ * same handle concurrently. Like file_handle, calls on
+ * a handle that is not open fail with ENOENT.
+ */
+struct fd_handle
+{
+    int descriptor{-1};
+    constexpr fd_handle() = default;
+    explicit constexpr fd_handle(int fd) : descriptor(fd) {}
+    fd_handle(const char* filename, int flags = O_RDONLY, mode_t mode = 0644)
+    {
+        open(filename, flags, mode);
+    }
+    result<ok, unix_err> open(const char* filename, int flags = O_RDONLY, mode_t mode = 0644)
+    {
+        close();
+        descriptor = ::open(filename, flags | O_CLOEXEC, mode);
+        if (descriptor < 0)
+            return unix_err::current();
+        return ok{};
+    }
+    fd_handle(fd_handle&& other)
+    {
+        std::swap(descriptor, other.descriptor);
+    }
+    fd_handle& operator=(fd_handle&& other)
+    {
+        std::swap(descriptor, other.descriptor);
+        return *this;
+    }
+    common_bugless_constexpr bool good() const
+    {
+        return is_open();
+    }
+    common_bugless_constexpr bool is_open() const
+    {
+        return (descriptor >= 0);
+    }
+    size_t size() const
+    {
+        if (!good())
+            return 0;
+        struct stat stat_buf;
+        int err = ::fstat(descriptor, &stat_buf);
+        if (err == 0)
+            return stat_buf.st_size;
+        return 0;
+    }
+
+    /// pread() until into is full or end of file, returning the filled head
+    result<array_view<char>, unix_err> read_at(array_view<char> into, uint64_t offset) const
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        size_t done = 0;
+        while (done < into.size()) {
+            const ssize_t ret = ::pread(descriptor, into.data() + done, into.size() - done, off_t(offset + done));
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                return unix_err::current();
+            }
+            if (ret == 0)
+                break;
+            done += ret;
+        }
+        return into.head(done);
+    }
+    /// pwrite() all of bytes at offset
+    result<ok, unix_err> write_at(array_view<const char> bytes, uint64_t offset) const
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        size_t done = 0;
+        while (done < bytes.size()) {
+            const ssize_t ret = ::pwrite(descriptor, bytes.data() + done, bytes.size() - done, off_t(offset + done));
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                return unix_err::current();
+            }
+            // Nothing written for a non-empty request would otherwise loop forever
+            if (ret == 0)
+                return unix_err{EIO};
+            done += ret;
+        }
+        return ok{};
+    }
+    /// read() from the current position until into is full or end of file
+    result<array_view<char>, unix_err> read_view(array_view<char> into)
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        size_t done = 0;
+        while (done < into.size()) {
+            const ssize_t ret = ::read(descriptor, into.data() + done, into.size() - done);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                return unix_err::current();
+            }
+            if (ret == 0)
+                break;
+            done += ret;
+        }
+        return into.head(done);
+    }
+    /// write() all of bytes at the current position
+    result<ok, unix_err> write(array_view<const char> bytes)
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        size_t done = 0;
+        while (done < bytes.size()) {
+            const ssize_t ret = ::write(descriptor, bytes.data() + done, bytes.size() - done);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                return unix_err::current();
+            }
+            if (ret == 0)
+                return unix_err{EIO};
+            done += ret;
+        }
+        return ok{};
+    }
+
+    /// writev() all of parts at the current position, e.g. {header, key, payload}
+    result<ok, unix_err> write_all(array_view<const array_view<const char>> parts)
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        return impl::write_vectored(parts, [this] (const struct iovec* iov, int count, uint64_t) {
+            return ::writev(descriptor, iov, count);
+        });
+    }
+    /// pwritev() all of parts, contiguously from offset
+    result<ok, unix_err> write_all_at(array_view<const array_view<const char>> parts, uint64_t offset) const
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        return impl::write_vectored(parts, [this, offset] (const struct iovec* iov, int count, uint64_t written) {
+            return ::pwritev(descriptor, iov, count, off_t(offset + written));
+        });
+    }
+    /**
+     * Page-cache hints. A range of [offset, offset + bytes) with bytes of 0
+     * extends to the end of the file, as with posix_fadvise().
+     */
+    result<ok, unix_err> advise_sequential() const
+    {
+        return impl::fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    result<ok, unix_err> advise_random() const
+    {
+        return impl::fadvise(descriptor, 0, 0, POSIX_FADV_RANDOM);
+    }
+    /// Drop cached pages of a range already consumed, sparing other processes' working sets
+    result<ok, unix_err> advise_dontneed(uint64_t offset = 0, uint64_t bytes = 0) const
+    {
+        return impl::fadvise(descriptor, offset, bytes, POSIX_FADV_DONTNEED);
+    }
+    /// Read a range into the page cache, blocking until the reads are issued
+    result<ok, unix_err> readahead(uint64_t offset, uint64_t bytes) const
+    {
+        return impl::readahead(descriptor, offset, bytes);
+    }
+    /// Start reading a range into the page cache in the background
+    result<ok, unix_err> prefetch_async(uint64_t offset = 0, uint64_t bytes = 0) const
+    {
+        return impl::fadvise(descriptor, offset, bytes, POSIX_FADV_WILLNEED);
+    }
+    /// fsync(): flush data and metadata to stable storage
+    result<ok, unix_err> sync() const
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        if (::fsync(descriptor) != 0)
+            return unix_err::current();
+        return ok{};
+    }
+    /// fdatasync(): flush data, and only the metadata needed to read it back
+    result<ok, unix_err> datasync() const
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        if (::fdatasync(descriptor) != 0)
+            return unix_err::current();
+        return ok{};
+    }
+    int release()
+    {
+        int released = descriptor;
+        descriptor = -1;
+        return released;
+    }
+    void close()
+    {
+        if (descriptor >= 0) {
+            ::close(descriptor);
+            descriptor = -1;
+        }
+    }
+    ~fd_handle()
+    {
+        if (descriptor >= 0)
+            ::close(descriptor);
+    }
+    int fd() const
+    {
+        return descriptor;
+    }
+};
+
+/// fsync() the directory holding path, so that creating or renaming path survives a crash
+inline result<ok, unix_err> sync_parent_directory(const char* path)
+{
+    const char* slash = ::strrchr(path, '/');
+    const std::string dir = !slash ? std::string(".") : slash == path ? std::string("/") : std::string(path, slash);
+    fd_handle handle;
+    auto res = handle.open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (res)
+        res = handle.sync();
+    return res;
+}
+
+} // namespace common
+
+#endif // COMMON_FD_HANDLE_HPP
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_FILE_COPY_HPP
+#define COMMON_FILE_COPY_HPP
+
+#include <algorithm>
+#include <sys/sendfile.h>
+#include <vector>
+
+#include "common_result.hpp"
+#include "unix_err.hpp"
+#include "fd_handle.hpp"
+#include "file_handle.hpp"
+
+namespace common
+{
+
+/// Ways of moving file data, from most to least kernel-side
+enum class copy_method
+{
+    copy_file_range, ///< file to file, may share extents (reflink) on CoW filesystems
+    sendfile,        ///< file to anything, no user-space copy
+    splice,          ///< file to anything through a pipe
+    buffer,          ///< pread()/write() through a reused per-thread buffer
+};
+
+namespace impl
+{
+
+enum { COPY_CHUNK = 1 << 30, COPY_BUFFER = 1 << 20 };
+
+inline bool copy_unsupported(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP
+        || err == EBADF || err == ESPIPE;
+}
+
+inline ssize_t splice_through_pipe(int out_fd, int in_fd, uint64_t offset, size_t len)
+{
+    struct pipe_pair
+    {
+        int fds[2] = {-1, -1};
+        ~pipe_pair()
+        {
+            if (fds[0] >= 0) {
+                ::close(fds[0]);
+                ::close(fds[1]);
+            }
+        }
+    };
+    thread_local pipe_pair pipe;
+    if (pipe.fds[0] < 0) {
+        if (::pipe2(pipe.fds, O_CLOEXEC) != 0)
+            return -1;
+        ::fcntl(pipe.fds[1], F_SETPIPE_SZ, int(COPY_BUFFER));
+    }
+    loff_t in_offset = loff_t(offset);
+    const ssize_t filled = ::splice(in_fd, &in_offset, pipe.fds[1], nullptr, len, SPLICE_F_MOVE);
+    if (filled <= 0)
+        return filled;
+    ssize_t drained = 0;
+    while (drained < filled) {
+        const ssize_t ret = ::splice(pipe.fds[0], nullptr, out_fd, nullptr, size_t(filled - drained), SPLICE_F_MOVE);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0) {
+            // The pipe holds data that will never arrive; start afresh next time
+            const int err = (ret < 0) ? errno : EIO;
+            ::close(pipe.fds[0]);
+            ::close(pipe.fds[1]);
+            pipe.fds[0] = pipe.fds[1] = -1;
+            // Report what did arrive, so no fallback method sends it again
+            if (drained > 0)
+                return drained;
+            errno = err;
+            return -1;
+        }
+        drained += ret;
+    }
+    return filled;
+}
+
+inline ssize_t copy_through_buffer(int out_fd, int in_fd, uint64_t offset, size_t len)
+{
+    thread_local std::vector<char> buffer(COPY_BUFFER);
+    ssize_t got;
+    do {
+        got = ::pread(in_fd, buffer.data(), std::min(len, buffer.size()), off_t(offset));
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0)
+        return got;
+    ssize_t written = 0;
+    while (written < got) {
+        const ssize_t ret = ::write(out_fd, buffer.data() + written, size_t(got - written));
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (ret == 0) {
+            errno = EIO;
+            return -1;
+        }
+        written += ret;
+    }
+    return got;
+}
+
+/**
+ * Move up to len bytes from in_fd at offset to the current position of
+ * out_fd, stopping early at end of file. Starts with method and steps
+ * down to the next one whenever the kernel rejects a pairing of fds.
+ */
+inline result<size_t, unix_err> transfer(int out_fd, int in_fd, uint64_t offset, size_t len,
+        copy_method method = copy_method::copy_file_range)
+{
+    size_t done = 0;
+    while (done < len) {
+        const size_t want = std::min(len - done, size_t(COPY_CHUNK));
+        const uint64_t at = offset + done;
+        ssize_t ret = -1;
+        switch (method) {
+            case copy_method::copy_file_range: {
+                loff_t in_offset = loff_t(at);
+                ret = ::copy_file_range(in_fd, &in_offset, out_fd, nullptr, want, 0);
+                break;
+            }
+            case copy_method::sendfile: {
+                off_t in_offset = off_t(at);
+                ret = ::sendfile(out_fd, in_fd, &in_offset, want);
+                break;
+            }
+            case copy_method::splice:
+                ret = splice_through_pipe(out_fd, in_fd, at, want);
+                break;
+            case copy_method::buffer:
+                ret = copy_through_buffer(out_fd, in_fd, at, want);
+                break;
+        }
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (method != copy_method::buffer && copy_unsupported(errno)) {
+                method = copy_method(int(method) + 1);
+                continue;
+            }
+            return unix_err::current();
+        }
+        if (ret == 0) {
+            // Some pseudo-filesystems report 0 from copy_file_range() whatever their size
+            if (method == copy_method::copy_file_range && done == 0) {
+                method = copy_method::sendfile;
+                continue;
+            }
+            break;
+        }
+        done += size_t(ret);
+    }
+    return done;
+}
+
+} // namespace impl
+
+/**
+ * Send up to len bytes of in, from offset, to the current position of
+ * fd_out (a file, pipe or socket) without copying through user space
+ * where the kernel allows it. Returns the bytes sent, fewer than len
+ * only at end of file.
+ */
+inline result<size_t, unix_err> send_file(int fd_out, const fd_handle& in, uint64_t offset, size_t len)
+{
+    if (!in.good())
+        return unix_err{ENOENT};
+    return impl::transfer(fd_out, in.fd(), offset, len);
+}
+inline result<size_t, unix_err> send_file(int fd_out, file_handle& in, uint64_t offset, size_t len)
+{
+    if (!in.good())
+        return unix_err{ENOENT};
+    // Anything still buffered in the FILE* must reach the fd first
+    if (::fflush(in.file) != 0)
+        return unix_err::current();
+    return impl::transfer(fd_out, in.fd(), offset, len);
+}
+
+/**
+ * Copy the content of the regular file src into dst. A new dst is created
+ * with src's permissions (less the umask), an existing one is truncated and
+ * keeps its own, as with cp. Fails before touching dst when src is not a
+ * regular file (EISDIR for a directory, otherwise EINVAL), and with EINVAL,
+ * leaving it intact, when dst is src itself (or a link to it).
+ */
+inline result<size_t, unix_err> copy_file(const char* src, const char* dst)
+{
+    fd_handle in;
+    auto res = in.open(src);
+    if (!res)
+        return res.err();
+    struct stat stat_buf;
+    if (::fstat(in.fd(), &stat_buf) != 0)
+        return unix_err::current();
+    if (!S_ISREG(stat_buf.st_mode))
+        return unix_err{S_ISDIR(stat_buf.st_mode) ? EISDIR : EINVAL};
+    fd_handle out;
+    res = out.open(dst, O_WRONLY | O_CREAT, stat_buf.st_mode & 07777);
+    if (!res)
+        return res.err();
+    // Truncate only once dst is known to be another file
+    struct stat out_stat;
+    if (::fstat(out.fd(), &out_stat) != 0)
+        return unix_err::current();
+    if (out_stat.st_dev == stat_buf.st_dev && out_stat.st_ino == stat_buf.st_ino)
+        return unix_err{EINVAL};
+    if (::ftruncate(out.fd(), 0) != 0)
+        return unix_err::current();
+    return impl::transfer(out.fd(), in.fd(), 0, size_t(-1));
+}
+
+} // namespace common
+
+#endif // COMMON_FILE_COPY_HPP
@@ -31,6 +31,8 @@
 #include "common_result.hpp"
 #include "unix_err.hpp"
 #include "array_view.hpp"
+#include "fd_handle.hpp"
+#include "string_view.hpp"
 
 namespace common
 {
@@ -93,6 +95,22 @@ struct file_handle
             return ok{};
         return unix_err::current();
     }
+    /**
+     * Write all of parts with writev(), without staging them in one
+     * buffer. Anything already buffered by the FILE* is flushed first
+     * so the ordering of writes is kept.
+     */
+    result<ok, unix_err> write_all(array_view<const array_view<const char>> parts)
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        if (::fflush(file) != 0)
+            return unix_err::current();
+        const int descriptor = fd();
+        return impl::write_vectored(parts, [descriptor] (const struct iovec* iov, int count, uint64_t) {
+            return ::writev(descriptor, iov, count);
+        });
+    }
     result<ok, unix_err> read(array_view<char> into)
     {
         if (!good())
@@ -118,6 +136,92 @@ struct file_handle
         into.resize(size());
         return read(array_view<char>{&*into.begin(), into.size()});
     }
+    /**
+     * Stream the file through buffer, calling fn(string_view) for
+     * each record ending in delimiter (passed without it), and for
+     * any unterminated record at the end. Empty records are passed.
+     *
+     * Records straddling a refill are carried over to the start of
+     * buffer, so memory use is fixed by the caller, but a record
+     * longer than buffer (not counting its delimiter) fails with
+     * ENOBUFS. Returns the record count.
+     */
+    template <typename Fn>
+    result<size_t, unix_err> read_records(array_view<char> buffer, char delimiter, Fn&& fn)
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        if (buffer.empty())
+            return unix_err{EINVAL};
+        size_t carried = 0;
+        size_t count = 0;
+        while (true) {
+            const size_t got = ::fread(buffer.data() + carried, 1, buffer.size() - carried, file);
+            if (!got)
+                break;
+            const string_view filled{buffer.data(), carried + got};
+            const char* start = filled.begin();
+            while (const char* pos = static_cast<const char*>(::memchr(start, delimiter, filled.end() - start))) {
+                fn(string_view{start, pos});
+                count += 1;
+                start = pos + 1;
+            }
+            carried = filled.end() - start;
+            if (carried == buffer.size()) {
+                // A full buffer still fits a record if a delimiter or end of file comes next
+                const int next = ::fgetc(file);
+                if (next != EOF && char(next) != delimiter)
+                    return unix_err{ENOBUFS};
+                if (next == EOF && ::ferror(file))
+                    return unix_err::current();
+                fn(string_view{buffer.data(), carried});
+                count += 1;
+                carried = 0;
+                continue;
+            }
+            ::memmove(buffer.data(), start, carried);
+        }
+        if (::ferror(file))
+            return unix_err::current();
+        if (carried) {
+            fn(string_view{buffer.data(), carried});
+            count += 1;
+        }
+        return count;
+    }
+    /// read_records() split on newlines
+    template <typename Fn>
+    result<size_t, unix_err> read_lines(array_view<char> buffer, Fn&& fn)
+    {
+        return read_records(buffer, '\n', std::forward<Fn>(fn));
+    }
+    /**
+     * Page-cache hints. A range of [offset, offset + bytes) with bytes of 0
+     * extends to the end of the file, as with posix_fadvise().
+     */
+    result<ok, unix_err> advise_sequential() const
+    {
+        return impl::fadvise(fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    result<ok, unix_err> advise_random() const
+    {
+        return impl::fadvise(fd(), 0, 0, POSIX_FADV_RANDOM);
+    }
+    /// Drop cached pages of a range already consumed, sparing other processes' working sets
+    result<ok, unix_err> advise_dontneed(uint64_t offset = 0, uint64_t bytes = 0) const
+    {
+        return impl::fadvise(fd(), offset, bytes, POSIX_FADV_DONTNEED);
+    }
+    /// Read a range into the page cache, blocking until the reads are issued
+    result<ok, unix_err> readahead(uint64_t offset, uint64_t bytes) const
+    {
+        return impl::readahead(fd(), offset, bytes);
+    }
+    /// Start reading a range into the page cache in the background
+    result<ok, unix_err> prefetch_async(uint64_t offset = 0, uint64_t bytes = 0) const
+    {
+        return impl::fadvise(fd(), offset, bytes, POSIX_FADV_WILLNEED);
+    }
     void close()
     {
         if (file) {
@@ -130,7 +234,7 @@ struct file_handle
         if (file)
             fclose(file);
     }
-    int fd()
+    int fd() const
     {
         return good() ? fileno(file) : -1;
     }
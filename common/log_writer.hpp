@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_LOG_WRITER_HPP
+#define COMMON_LOG_WRITER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "common_optional.hpp"
+#include "common_result.hpp"
+#include "unix_err.hpp"
+#include "checksum.hpp"
+#include "fd_handle.hpp"
+#include "mapped_file.hpp"
+#include "string_view.hpp"
+
+namespace common
+{
+
+template <typename Fn>
+size_t read_log_records(string_view content, Fn&& fn);
+
+/// Group commit thresholds: a batch is held for up to max_delay, or until max_batch_bytes
+struct log_writer_options
+{
+    size_t max_batch_bytes = 1 << 20;
+    std::chrono::microseconds max_delay{0};
+};
+
+/**
+ * An append-only write-ahead log with group commit.
+ *
+ * Each record is framed as {uint32 length, uint32 crc32c, payload}
+ * (host byte order). append() blocks until its record is durable;
+ * concurrent appends are gathered into one write() and a single
+ * fdatasync() per batch: while one batch syncs, the next one fills.
+ * A leader may also hold a batch open for max_delay, or until it
+ * reaches max_batch_bytes, to trade latency for bigger groups.
+ *
+ * After a failed write or sync the state of the file is unknown, so
+ * the error is sticky and all further appends return it. Reopening
+ * cuts any torn or corrupt tail left by a crash before appending.
+ */
+struct log_writer
+{
+    using options = log_writer_options;
+    enum { HEADER_SIZE = 2 * sizeof(uint32_t) };
+
+    fd_handle file;
+    options opts;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<char> pending;
+    std::vector<char> writing;
+    uint64_t next_record_offset = 0;
+    uint64_t open_batch = 1;
+    uint64_t committed_batch = 0;
+    uint64_t failed_batch = UINT64_MAX;
+    bool flushing = false;
+    common::optional<unix_err> failed;
+
+    log_writer() = default;
+    log_writer(const log_writer&) = delete;
+    log_writer& operator=(const log_writer&) = delete;
+
+    /**
+     * Open or create a log, appending after its last valid record:
+     * a torn or corrupt tail is truncated away, durably, first. A new
+     * log's directory entry is synced too, so it cannot vanish with
+     * the records acknowledged in it.
+     */
+    result<ok, unix_err> open(const char* filename, options o = options{})
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto res = file.open(filename, O_RDWR | O_CREAT | O_EXCL);
+        if (res)
+            res = sync_parent_directory(filename);
+        else if (res.err().unix_errno == EEXIST)
+            res = file.open(filename, O_RDWR);
+        if (res)
+            res = recover();
+        if (!res) {
+            file.close();
+            return res;
+        }
+        opts = o;
+        pending.clear();
+        failed = common::none{};
+        failed_batch = UINT64_MAX;
+        return ok{};
+    }
+
+    /// Append a record, returning its offset once durable
+    result<uint64_t, unix_err> append(array_view<const char> record)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (failed)
+            return *failed;
+        if (!file.good())
+            return unix_err{ENOENT};
+        if (record.size() > UINT32_MAX)
+            return unix_err{EMSGSIZE};
+
+        const uint64_t record_offset = next_record_offset;
+        const uint64_t batch = open_batch;
+        const uint32_t header[2] = {uint32_t(record.size()), crc32c(record)};
+        const size_t start = pending.size();
+        pending.resize(start + HEADER_SIZE + record.size());
+        ::memcpy(&pending[start], header, HEADER_SIZE);
+        if (record.size())
+            ::memcpy(&pending[start + HEADER_SIZE], record.data(), record.size());
+        next_record_offset += HEADER_SIZE + record.size();
+        if (pending.size() >= opts.max_batch_bytes)
+            changed.notify_all();
+
+        while (committed_batch < batch) {
+            if (flushing) {
+                changed.wait(guard);
+                continue;
+            }
+            flush_as_leader(guard);
+        }
+        // Batches before the first failure are durable, whatever failed since
+        if (batch >= failed_batch)
+            return *failed;
+        return record_offset;
+    }
+
+private:
+    result<ok, unix_err> recover()
+    {
+        size_t valid = 0;
+        {
+            mapped_file existing;
+            auto res = existing.map(file.fd());
+            if (!res)
+                return res;
+            valid = read_log_records(string_view{existing.addr, existing.size()}, [] (string_view) {});
+            if (valid == existing.size()) {
+                next_record_offset = valid;
+                return ok{};
+            }
+        }
+        if (::ftruncate(file.fd(), off_t(valid)) != 0)
+            return unix_err::current();
+        auto res = file.datasync();
+        if (!res)
+            return res;
+        next_record_offset = valid;
+        return ok{};
+    }
+
+    void flush_as_leader(std::unique_lock<std::mutex>& guard)
+    {
+        flushing = true;
+        if (opts.max_delay.count() > 0) {
+            const auto deadline = std::chrono::steady_clock::now() + opts.max_delay;
+            changed.wait_until(guard, deadline, [this] { return pending.size() >= opts.max_batch_bytes; });
+        }
+        writing.swap(pending);
+        pending.clear();
+        const uint64_t batch = open_batch++;
+        const uint64_t offset = next_record_offset - writing.size();
+
+        // Once failed, the file may not match next_record_offset: fail the batch without writing
+        result<ok, unix_err> res = ok{};
+        if (failed) {
+            res = *failed;
+        } else {
+            guard.unlock();
+            res = file.write_at(writing, offset);
+            if (res)
+                res = file.datasync();
+            guard.lock();
+        }
+
+        if (!res && !failed) {
+            failed = res.err();
+            failed_batch = batch;
+        }
+        committed_batch = batch;
+        flushing = false;
+        changed.notify_all();
+    }
+};
+
+/**
+ * Walk the records of a log in content, calling fn(string_view payload)
+ * for each, and stopping at the first torn or corrupt frame.
+ * Returns the length of the valid prefix, where appending may resume.
+ */
+template <typename Fn>
+size_t read_log_records(string_view content, Fn&& fn)
+{
+    size_t valid = 0;
+    while (content.size() - valid >= log_writer::HEADER_SIZE) {
+        uint32_t header[2];
+        ::memcpy(header, content.data() + valid, log_writer::HEADER_SIZE);
+        const string_view payload = content.advance(valid + log_writer::HEADER_SIZE).head(header[0]);
+        if (payload.size() != header[0] || crc32c(payload) != header[1])
+            break;
+        fn(payload);
+        valid += log_writer::HEADER_SIZE + payload.size();
+    }
+    return valid;
+}
+
+} // namespace common
+
+#endif // COMMON_LOG_WRITER_HPP
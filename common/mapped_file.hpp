@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_MAPPED_FILE_HPP
+#define COMMON_MAPPED_FILE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common_result.hpp"
+#include "unix_err.hpp"
+#include "string_view.hpp"
+
+namespace common
+{
+
+/**
+ * A read-only mmap() of a whole file, unmapped on
+ * destruction, for zero-copy parsing straight out
+ * of the page cache:
+ *
+ *   mapped_file file;
+ *   file.open(filename)
+ *       .and_then([&] (ok) { return file.view(); })
+ *       .with_res([&] (string_view content) { ... });
+ */
+struct mapped_file
+{
+    enum class advice
+    {
+        normal,
+        sequential,
+        random,
+        willneed,
+        dontneed,
+        hugepage,
+    };
+
+    const char* addr{nullptr};
+    size_t length{0};
+    bool opened{false};
+
+    constexpr mapped_file() = default;
+    mapped_file(const char* filename)
+    {
+        open(filename);
+    }
+    mapped_file(mapped_file&& other)
+    {
+        swap(other);
+    }
+    mapped_file& operator=(mapped_file&& other)
+    {
+        swap(other);
+        return *this;
+    }
+    void swap(mapped_file& other)
+    {
+        std::swap(addr, other.addr);
+        std::swap(length, other.length);
+        std::swap(opened, other.opened);
+    }
+
+    result<ok, unix_err> open(const char* filename)
+    {
+        close();
+        int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return unix_err::current();
+        auto res = map(fd);
+        ::close(fd);
+        return res;
+    }
+    /// Map the whole of an open descriptor, which may be closed afterwards
+    result<ok, unix_err> map(int fd)
+    {
+        close();
+        struct stat stat_buf;
+        if (::fstat(fd, &stat_buf) != 0)
+            return unix_err::current();
+        // mmap() rejects empty mappings, but an empty file is a valid empty view
+        if (stat_buf.st_size > 0) {
+            void* mapping = ::mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+                return unix_err::current();
+            addr = static_cast<const char*>(mapping);
+            length = stat_buf.st_size;
+        }
+        opened = true;
+        return ok{};
+    }
+
+    common_bugless_constexpr bool good() const
+    {
+        return is_open();
+    }
+    common_bugless_constexpr bool is_open() const
+    {
+        return opened;
+    }
+    size_t size() const
+    {
+        return length;
+    }
+    result<string_view, unix_err> view() const
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        return string_view{addr, length};
+    }
+
+    /// Hint the expected access pattern to the kernel, for the whole mapping
+    result<ok, unix_err> advise(advice adv)
+    {
+        return advise(adv, 0, length);
+    }
+    /// Hint the access pattern of [offset, offset + bytes) of the mapping
+    result<ok, unix_err> advise(advice adv, size_t offset, size_t bytes)
+    {
+        if (!good())
+            return unix_err{ENOENT};
+        if (!length)
+            return ok{};
+        offset = std::min(offset, length);
+        bytes = std::min(bytes, length - offset);
+        // madvise() needs a page-aligned start
+        const size_t page = ::sysconf(_SC_PAGESIZE);
+        const size_t aligned = offset - (offset % page);
+        int native = 0;
+        switch (adv) {
+        case advice::normal:     native = MADV_NORMAL;     break;
+        case advice::sequential: native = MADV_SEQUENTIAL; break;
+        case advice::random:     native = MADV_RANDOM;     break;
+        case advice::willneed:   native = MADV_WILLNEED;   break;
+        case advice::dontneed:   native = MADV_DONTNEED;   break;
+        case advice::hugepage:
+#ifdef MADV_HUGEPAGE
+            native = MADV_HUGEPAGE;
+            break;
+#else
+            return unix_err{EINVAL};
+#endif
+        }
+        if (::madvise(const_cast<char*>(addr) + aligned, bytes + (offset - aligned), native) != 0)
+            return unix_err::current();
+        return ok{};
+    }
+
+    void close()
+    {
+        if (addr)
+            ::munmap(const_cast<char*>(addr), length);
+        addr = nullptr;
+        length = 0;
+        opened = false;
+    }
+    ~mapped_file()
+    {
+        close();
+    }
+};
+
+} // namespace common
+
+#endif // COMMON_MAPPED_FILE_HPP
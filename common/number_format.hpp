@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_NUMBER_FORMAT_HPP
+#define COMMON_NUMBER_FORMAT_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__has_include) && __cplusplus >= 201703L
+#  if __has_include(<charconv>)
+#    include <charconv>
+#  endif
+#endif
+
+#include "common/string_view.hpp"
+
+namespace common
+{
+
+/**
+ * The text of a single formatted number, held inline,
+ * as returned by integer_chars()/hex_chars()/double_chars().
+ */
+struct number_chars
+{
+    /// Room for the longest fixed-point double: sign, 309 digits, point and decimals
+    enum { MAX_PRECISION = 40, CAPACITY = 1 + 309 + 1 + MAX_PRECISION };
+    char buf[CAPACITY];
+    size_t len = 0;
+
+    common::string_view str() const { return common::string_view{buf, std::min<size_t>(len, CAPACITY)}; }
+    operator common::string_view() const { return str(); }
+};
+
+namespace impl
+{
+
+inline const char* digit_pairs()
+{
+    static const char pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    return pairs;
+}
+
+inline size_t decimal_digits(uint64_t value)
+{
+    size_t digits = 1;
+    for (uint64_t power = 10; digits < 20 && value >= power; power *= 10)
+        digits += 1;
+    return digits;
+}
+
+/// Writes the decimal digits of value ending just before end, returning the first
+inline char* write_decimal_backwards(char* end, uint64_t value)
+{
+    const char* pairs = digit_pairs();
+    while (value >= 100) {
+        const size_t pair = size_t(value % 100) * 2;
+        value /= 100;
+        end -= 2;
+        ::memcpy(end, pairs + pair, 2);
+    }
+    if (value >= 10) {
+        end -= 2;
+        ::memcpy(end, pairs + value * 2, 2);
+    } else {
+        *--end = char('0' + value);
+    }
+    return end;
+}
+
+/**
+ * Just enough of an unsigned big integer for exact double to decimal
+ * conversion: 40 words hold 2^1074 scaled by a few powers of ten.
+ */
+struct decimal_bignum
+{
+    enum { WORDS = 40 };
+    uint32_t words[WORDS] = {};
+    unsigned size = 0;
+
+    decimal_bignum() = default;
+    explicit decimal_bignum(uint64_t value)
+    {
+        words[0] = uint32_t(value);
+        words[1] = uint32_t(value >> 32);
+        size = words[1] ? 2 : words[0] ? 1 : 0;
+    }
+
+    bool is_zero() const { return size == 0; }
+    bool is_odd() const { return size && (words[0] & 1); }
+
+    void mul_small(uint32_t factor)
+    {
+        uint64_t carry = 0;
+        for (unsigned i = 0; i < size; ++i) {
+            carry += uint64_t(words[i]) * factor;
+            words[i] = uint32_t(carry);
+            carry >>= 32;
+        }
+        if (carry)
+            words[size++] = uint32_t(carry);
+    }
+    void mul_pow10(unsigned exponent)
+    {
+        static const uint32_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+        for (; exponent >= 9; exponent -= 9)
+            mul_small(1000000000);
+        if (exponent)
+            mul_small(powers[exponent]);
+    }
+    void shift_left(unsigned bits)
+    {
+        if (!size)
+            return;
+        const unsigned whole = bits / 32, part = bits % 32;
+        if (part) {
+            const uint32_t top = words[size - 1] >> (32 - part);
+            for (unsigned i = size - 1; i > 0; --i)
+                words[i] = (words[i] << part) | (words[i - 1] >> (32 - part));
+            words[0] <<= part;
+            if (top)
+                words[size++] = top;
+        }
+        if (whole) {
+            ::memmove(words + whole, words, size * sizeof(uint32_t));
+            ::memset(words, 0, whole * sizeof(uint32_t));
+            size += whole;
+        }
+    }
+    void shift_right(unsigned bits)
+    {
+        const unsigned whole = bits / 32, part = bits % 32;
+        if (whole >= size) {
+            size = 0;
+            return;
+        }
+        ::memmove(words, words + whole, (size - whole) * sizeof(uint32_t));
+        size -= whole;
+        if (part) {
+            for (unsigned i = 0; i + 1 < size; ++i)
+                words[i] = (words[i] >> part) | (words[i + 1] << (32 - part));
+            words[size - 1] >>= part;
+        }
+        trim();
+    }
+    void add(const decimal_bignum& other)
+    {
+        const unsigned count = std::max(size, other.size);
+        uint64_t carry = 0;
+        for (unsigned i = 0; i < count; ++i) {
+            carry += uint64_t(i < size ? words[i] : 0) + (i < other.size ? other.words[i] : 0);
+            words[i] = uint32_t(carry);
+            carry >>= 32;
+        }
+        size = count;
+        if (carry)
+            words[size++] = uint32_t(carry);
+    }
+    /// Requires *this >= other
+    void sub(const decimal_bignum& other)
+    {
+        uint64_t borrow = 0;
+        for (unsigned i = 0; i < size; ++i) {
+            const uint64_t diff = uint64_t(words[i]) - (i < other.size ? other.words[i] : 0) - borrow;
+            words[i] = uint32_t(diff);
+            borrow = (diff >> 32) ? 1 : 0;
+        }
+        trim();
+    }
+    /// Divide by 10^9 in place, returning the remainder
+    uint32_t divmod_billion()
+    {
+        uint64_t rem = 0;
+        for (unsigned i = size; i-- > 0; ) {
+            const uint64_t cur = (rem << 32) | words[i];
+            words[i] = uint32_t(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        trim();
+        return uint32_t(rem);
+    }
+    void trim()
+    {
+        while (size && !words[size - 1])
+            size -= 1;
+    }
+
+    static int compare(const decimal_bignum& a, const decimal_bignum& b)
+    {
+        if (a.size != b.size)
+            return a.size < b.size ? -1 : 1;
+        for (unsigned i = a.size; i-- > 0; ) {
+            if (a.words[i] != b.words[i])
+                return a.words[i] < b.words[i] ? -1 : 1;
+        }
+        return 0;
+    }
+    /// Compare a + b with c
+    static int compare_sum(const decimal_bignum& a, const decimal_bignum& b, const decimal_bignum& c)
+    {
+        decimal_bignum sum = a;
+        sum.add(b);
+        return compare(sum, c);
+    }
+    /// The decimal digit floor(*this / divisor), leaving the remainder; requires a quotient below 10
+    unsigned divmod_digit(const decimal_bignum& divisor)
+    {
+        unsigned digit = 0;
+        while (compare(*this, divisor) >= 0) {
+            sub(divisor);
+            digit += 1;
+        }
+        return digit;
+    }
+    /// Decimal digits into out (at least 1), returning the count
+    size_t to_decimal(char* out) const
+    {
+        decimal_bignum rest = *this;
+        char reversed[decimal_bignum::WORDS * 10];
+        size_t count = 0;
+        do {
+            uint32_t chunk = rest.divmod_billion();
+            for (int i = 0; i < 9 && (chunk || !rest.is_zero() || i == 0); ++i) {
+                reversed[count++] = char('0' + chunk % 10);
+                chunk /= 10;
+            }
+        } while (!rest.is_zero());
+        for (size_t i = 0; i < count; ++i)
+            out[i] = reversed[count - 1 - i];
+        return count;
+    }
+};
+
+/// A finite, non-negative double as mantissa * 2^exponent
+struct double_parts
+{
+    uint64_t mantissa;
+    int exponent;
+    bool asymmetric; ///< the gap below is half the gap above (a power of two)
+};
+
+inline double_parts decompose(double value)
+{
+    uint64_t bits;
+    ::memcpy(&bits, &value, sizeof(bits));
+    const uint64_t fraction = bits & ((uint64_t(1) << 52) - 1);
+    const int biased = int((bits >> 52) & 0x7ff);
+    if (biased == 0)
+        return double_parts{fraction, -1074, false};
+    return double_parts{fraction | (uint64_t(1) << 52), biased - 1075, fraction == 0 && biased > 1};
+}
+
+/// Exact fixed-point digits of a finite non-negative value, rounded half to even like printf
+inline size_t format_fixed(char* out, double value, int precision)
+{
+    const double_parts parts = decompose(value);
+    decimal_bignum digits{parts.mantissa};
+    if (parts.exponent >= 0) {
+        digits.shift_left(unsigned(parts.exponent));
+        digits.mul_pow10(unsigned(precision));
+    } else {
+        const unsigned shift = unsigned(-parts.exponent);
+        decimal_bignum scaled = digits;
+        scaled.mul_pow10(unsigned(precision));
+        digits = scaled;
+        digits.shift_right(shift);
+        decimal_bignum truncated = digits;
+        truncated.shift_left(shift);
+        scaled.sub(truncated);
+        decimal_bignum half{1};
+        half.shift_left(shift - 1);
+        const int cmp = decimal_bignum::compare(scaled, half);
+        if (cmp > 0 || (cmp == 0 && digits.is_odd()))
+            digits.add(decimal_bignum{1});
+    }
+    char buf[number_chars::CAPACITY];
+    size_t count = digits.to_decimal(buf);
+    // At least one integer digit before the decimals
+    const size_t wanted = size_t(precision) + 1;
+    if (count < wanted) {
+        ::memmove(buf + (wanted - count), buf, count);
+        ::memset(buf, '0', wanted - count);
+        count = wanted;
+    }
+    const size_t int_digits = count - size_t(precision);
+    ::memcpy(out, buf, int_digits);
+    size_t len = int_digits;
+    if (precision > 0) {
+        out[len++] = '.';
+        ::memcpy(out + len, buf + int_digits, size_t(precision));
+        len += size_t(precision);
+    }
+    return len;
+}
+
+/**
+ * The shortest digits that read back as value (Burger & Dybvig's free-format
+ * algorithm), nearest to it when several qualify, with value ~= 0.digits * 10^k.
+ * value must be finite and positive.
+ */
+inline size_t shortest_digits(char* out, double value, int& k)
+{
+    const double_parts parts = decompose(value);
+    const bool inclusive = (parts.mantissa & 1) == 0;
+    decimal_bignum r{parts.mantissa}, s{1}, m_plus{1}, m_minus{1};
+    const unsigned scale = parts.asymmetric ? 2 : 1;
+    r.shift_left(scale);
+    s.shift_left(scale);
+    m_plus.shift_left(scale - 1);
+    if (parts.exponent >= 0) {
+        r.shift_left(unsigned(parts.exponent));
+        m_plus.shift_left(unsigned(parts.exponent));
+        m_minus.shift_left(unsigned(parts.exponent));
+    } else {
+        s.shift_left(unsigned(-parts.exponent));
+    }
+
+    k = int(std::ceil(std::log10(value) - 1e-10));
+    if (k >= 0) {
+        s.mul_pow10(unsigned(k));
+    } else {
+        r.mul_pow10(unsigned(-k));
+        m_plus.mul_pow10(unsigned(-k));
+        m_minus.mul_pow10(unsigned(-k));
+    }
+    // Fix the estimate so that (r + m_plus) / s lies in [0.1, 1)
+    while (true) {
+        const int cmp = decimal_bignum::compare_sum(r, m_plus, s);
+        if (!(inclusive ? cmp >= 0 : cmp > 0))
+            break;
+        s.mul_small(10);
+        k += 1;
+    }
+    while (true) {
+        decimal_bignum high = r;
+        high.add(m_plus);
+        high.mul_small(10);
+        const int cmp = decimal_bignum::compare(high, s);
+        if (inclusive ? cmp >= 0 : cmp > 0)
+            break;
+        r.mul_small(10);
+        m_plus.mul_small(10);
+        m_minus.mul_small(10);
+        k -= 1;
+    }
+
+    size_t len = 0;
+    while (true) {
+        r.mul_small(10);
+        m_plus.mul_small(10);
+        m_minus.mul_small(10);
+        unsigned digit = r.divmod_digit(s);
+        const int cmp_low = decimal_bignum::compare(r, m_minus);
+        const int cmp_high = decimal_bignum::compare_sum(r, m_plus, s);
+        const bool low = inclusive ? cmp_low <= 0 : cmp_low < 0;
+        const bool high = inclusive ? cmp_high >= 0 : cmp_high > 0;
+        if (!low && !high) {
+            out[len++] = char('0' + digit);
+            continue;
+        }
+        if (low && high) {
+            const int cmp_mid = decimal_bignum::compare_sum(r, r, s);
+            if (cmp_mid > 0 || (cmp_mid == 0 && (digit & 1)))
+                digit += 1;
+        } else if (high) {
+            digit += 1;
+        }
+        out[len++] = char('0' + digit);
+        return len;
+    }
+}
+
+/**
+ * What std::to_chars(first, last, value) produces: the shortest digits, laid
+ * out fixed or scientific, whichever is shorter (fixed on a tie).
+ */
+inline size_t format_shortest(char* out, double value)
+{
+    if (value == 0) {
+        out[0] = '0';
+        return 1;
+    }
+    char digits[20];
+    int k;
+    const size_t n = shortest_digits(digits, value, k);
+
+    const int exponent = k - 1;
+    const unsigned abs_exponent = unsigned(exponent < 0 ? -exponent : exponent);
+    const size_t sci_len = n + (n > 1 ? 1 : 0) + 2 + (abs_exponent >= 100 ? 3 : 2);
+    const size_t fixed_len = (k <= 0) ? 2 + size_t(-k) + n : (size_t(k) < n) ? n + 1 : size_t(k);
+    if (fixed_len <= sci_len) {
+        // Integers are printed exactly, as the digits may have been shortened
+        if (k > 0 && size_t(k) >= n)
+            return format_fixed(out, value, 0);
+        size_t len = 0;
+        if (k <= 0) {
+            out[len++] = '0';
+            out[len++] = '.';
+            for (int i = 0; i < -k; ++i)
+                out[len++] = '0';
+            ::memcpy(out + len, digits, n);
+            return len + n;
+        }
+        ::memcpy(out, digits, size_t(k));
+        len = size_t(k);
+        out[len++] = '.';
+        ::memcpy(out + len, digits + k, n - size_t(k));
+        return len + n - size_t(k);
+    }
+    size_t len = 0;
+    out[len++] = digits[0];
+    if (n > 1) {
+        out[len++] = '.';
+        ::memcpy(out + len, digits + 1, n - 1);
+        len += n - 1;
+    }
+    out[len++] = 'e';
+    out[len++] = exponent < 0 ? '-' : '+';
+    if (abs_exponent >= 100)
+        out[len++] = char('0' + abs_exponent / 100);
+    out[len++] = char('0' + abs_exponent / 10 % 10);
+    out[len++] = char('0' + abs_exponent % 10);
+    return len;
+}
+
+/// double_chars() without std::to_chars(): exact, and locale- and allocation-free
+inline number_chars format_double(double value, int precision)
+{
+    number_chars out;
+    size_t len = 0;
+    if (std::signbit(value))
+        out.buf[len++] = '-';
+    if (std::isnan(value)) {
+        ::memcpy(out.buf + len, "nan", 3);
+        out.len = len + 3;
+        return out;
+    }
+    if (std::isinf(value)) {
+        ::memcpy(out.buf + len, "inf", 3);
+        out.len = len + 3;
+        return out;
+    }
+    value = std::fabs(value);
+    out.len = len + ((precision < 0) ? format_shortest(out.buf + len, value)
+                                     : format_fixed(out.buf + len, value, precision));
+    return out;
+}
+
+} // namespace impl
+
+/// Decimal text of an integer, without going through printf
+template <typename T>
+number_chars integer_chars(T value)
+{
+    static_assert(std::is_integral<T>::value, "integer_chars() needs an integer");
+    using unsigned_type = typename std::make_unsigned<T>::type;
+    number_chars out;
+    const bool negative = value < 0;
+    const unsigned_type magnitude = negative ? unsigned_type(0) - unsigned_type(value) : unsigned_type(value);
+    out.len = impl::decimal_digits(magnitude) + (negative ? 1 : 0);
+    impl::write_decimal_backwards(out.buf + out.len, uint64_t(magnitude));
+    if (negative)
+        out.buf[0] = '-';
+    return out;
+}
+
+/// Lower-case hex text of value, zero padded to at least min_digits
+inline number_chars hex_chars(uint64_t value, unsigned min_digits = 1)
+{
+    static const char digits[] = "0123456789abcdef";
+    number_chars out;
+    size_t count = 1;
+    while (count < 16 && (value >> (count * 4)))
+        count += 1;
+    out.len = std::max<size_t>(count, std::min(min_digits, 16u));
+    for (size_t i = out.len; i > 0; --i) {
+        out.buf[i - 1] = digits[value & 0xf];
+        value >>= 4;
+    }
+    return out;
+}
+
+/**
+ * Text of a double: the shortest representation that reads
+ * back as the same value when precision < 0 (fixed or
+ * scientific, whichever is shorter), else fixed-point with
+ * precision decimals, at most MAX_PRECISION, exactly as
+ * printf("%.*f") prints it in the "C" locale.
+ *
+ * Uses std::to_chars() (Ryu-based) where available, and an
+ * exact big-integer conversion otherwise: both builds give
+ * the same text, independent of the locale.
+ */
+inline number_chars double_chars(double value, int precision = -1)
+{
+    if (precision > number_chars::MAX_PRECISION)
+        precision = number_chars::MAX_PRECISION;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    number_chars out;
+    char* const first = out.buf;
+    char* const last = out.buf + number_chars::CAPACITY;
+    const std::to_chars_result res = (precision < 0) ? std::to_chars(first, last, value)
+                                                     : std::to_chars(first, last, value, std::chars_format::fixed, precision);
+    // CAPACITY fits any double, so this cannot fail
+    out.len = res.ptr - first;
+    return out;
+#else
+    return impl::format_double(value, precision);
+#endif
+}
+
+} // namespace common
+
+#endif // COMMON_NUMBER_FORMAT_HPP
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_PARALLEL_SPLIT_HPP
+#define COMMON_PARALLEL_SPLIT_HPP
+
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include "common/string_view.hpp"
+
+namespace common
+{
+
+namespace impl
+{
+
+/// Cut source into at most max_chunks pieces, each ending just after a c
+template <typename T>
+std::vector<basic_string_view<T>> split_chunks(basic_string_view<T> source, T c, size_t max_chunks, size_t min_chunk_bytes)
+{
+    std::vector<basic_string_view<T>> chunks;
+    const size_t chunk_count = std::max<size_t>(1, std::min(max_chunks, source.size() / std::max<size_t>(1, min_chunk_bytes)));
+    const size_t target_size = source.size() / chunk_count;
+    basic_string_view<T> remaining = source;
+    while (remaining.size() && chunks.size() + 1 < chunk_count) {
+        const auto split_at = remaining.advance(target_size).find_char(c);
+        if (!split_at)
+            break;
+        const size_t chunk_size = target_size + *split_at + 1;
+        chunks.push_back(remaining.head(chunk_size));
+        remaining = remaining.advance(chunk_size);
+    }
+    if (remaining.size() || chunks.empty())
+        chunks.push_back(remaining);
+    return chunks;
+}
+
+} // namespace impl
+
+/**
+ * Splits large buffers as per split_fn(c, ...), but in
+ * chunks cut on c and handed to one thread each.
+ *
+ * Each chunk gets its own Acc, passed to fn(Acc&, token)
+ * along with the tokens of that chunk in order. The
+ * accumulators are returned in chunk order, so walking
+ * them preserves the ordering of the input.
+ *
+ *   auto counts = split_fn_parallel<size_t>(content, '\n', 0,
+ *       [] (size_t& count, string_view line) { count += 1; });
+ *
+ * threads = 0 uses std::thread::hardware_concurrency(), and
+ * chunks are kept to at least min_chunk_bytes so small inputs
+ * stay on the calling thread.
+ *
+ * An exception thrown by fn ends its chunk; once all threads
+ * have joined, the first one in chunk order is rethrown.
+ */
+template <typename Acc, typename T, class Fn>
+std::vector<Acc> split_fn_parallel(basic_string_view<T> source, typename std::remove_const<T>::type c, size_t threads, Fn&& fn, size_t min_chunk_bytes = 1 << 20)
+{
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    const std::vector<basic_string_view<T>> chunks = impl::split_chunks<T>(source, c, threads, min_chunk_bytes);
+    std::vector<Acc> accumulators(chunks.size());
+    std::vector<std::exception_ptr> errors(chunks.size());
+
+    auto run_chunk = [&] (size_t index) {
+        try {
+            Acc& acc = accumulators[index];
+            chunks[index].split_fn(c, [&] (basic_string_view<T> token) {
+                fn(acc, token);
+            });
+        } catch (...) {
+            errors[index] = std::current_exception();
+        }
+    };
+    {
+        // Joins on every exit, including a failed thread start
+        struct join_all
+        {
+            std::vector<std::thread> workers;
+            ~join_all()
+            {
+                for (std::thread& worker : workers)
+                    worker.join();
+            }
+        } threads_guard;
+        threads_guard.workers.reserve(chunks.size() - 1);
+        for (size_t i = 1; i < chunks.size(); ++i)
+            threads_guard.workers.emplace_back(run_chunk, i);
+        run_chunk(0);
+    }
+    // Rethrow the first failure in chunk order, once all threads are done
+    for (const std::exception_ptr& error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+    return accumulators;
+}
+
+} // namespace common
+
+#endif // COMMON_PARALLEL_SPLIT_HPP
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_STATIC_FORMAT_HPP
+#define COMMON_STATIC_FORMAT_HPP
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "common/number_format.hpp"
+#include "common/string_view.hpp"
+
+/**
+ * Wraps a string literal as a type, so static_format() can
+ * parse and check it at compile time (requires C++14).
+ *
+ *   fmt.format(COMMON_FMT("id=%d name=%s took %.3fs"), id, name, secs);
+ */
+#define COMMON_FMT(literal) ([] {                                                   \
+    struct common_fmt_literal { static constexpr const char* value() { return literal; } }; \
+    return common_fmt_literal{};                                                    \
+}())
+
+namespace common
+{
+
+namespace impl
+{
+
+/// Literal text up to a placeholder, and that placeholder
+struct format_segment
+{
+    size_t text_begin = 0;
+    size_t text_end = 0;
+    // '\0' for the trailing text, '%' for a literal percent sign
+    char conversion = '\0';
+    int precision = -1;
+    unsigned width = 0;
+    bool valid = true;
+};
+
+constexpr bool is_format_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+constexpr bool is_format_length_modifier(char c)
+{
+    return c == 'h' || c == 'l' || c == 'z' || c == 'j' || c == 't';
+}
+/// The printf() subset supported: length modifiers are accepted and
+/// ignored (types come from the arguments), zero-padded widths are
+/// only supported for %x, and precision only for %f.
+constexpr bool is_supported_segment(const format_segment& seg)
+{
+    switch (seg.conversion) {
+    case 'd': case 'i': case 'u': case 's': case 'c': case '%':
+        return seg.width == 0 && seg.precision < 0;
+    case 'x':
+        return seg.precision < 0;
+    case 'f':
+        return seg.width == 0;
+    }
+    return false;
+}
+
+constexpr bool consumes_argument(char conversion)
+{
+    return conversion != '\0' && conversion != '%';
+}
+
+/// The segment starting at pos, leaving pos after it
+constexpr format_segment parse_segment(const char* fmt, size_t& pos)
+{
+    format_segment seg{};
+    seg.text_begin = pos;
+    while (fmt[pos] && fmt[pos] != '%')
+        ++pos;
+    seg.text_end = pos;
+    if (!fmt[pos])
+        return seg;
+    ++pos;
+    if (fmt[pos] == '0') {
+        seg.width = 0;
+        for (++pos; is_format_digit(fmt[pos]); ++pos)
+            seg.width = seg.width * 10 + unsigned(fmt[pos] - '0');
+        seg.valid = seg.width > 0;
+    }
+    if (fmt[pos] == '.') {
+        seg.precision = 0;
+        for (++pos; is_format_digit(fmt[pos]); ++pos)
+            seg.precision = seg.precision * 10 + (fmt[pos] - '0');
+    }
+    while (is_format_length_modifier(fmt[pos]))
+        ++pos;
+    seg.conversion = fmt[pos];
+    if (!fmt[pos]) {
+        seg.valid = false;
+        return seg;
+    }
+    ++pos;
+    seg.valid = seg.valid && is_supported_segment(seg);
+    return seg;
+}
+
+/// Upper bound on the segments of fmt: one per '%', plus the trailing text
+constexpr size_t format_segment_bound(const char* fmt)
+{
+    size_t count = 1;
+    for (size_t pos = 0; fmt[pos]; ++pos)
+        count += (fmt[pos] == '%') ? 1 : 0;
+    return count;
+}
+
+/// Every segment of a format string, with the argument each one consumes
+template <size_t N>
+struct format_table
+{
+    format_segment segments[N];
+    size_t arg_index[N] = {};
+    size_t count = 0; ///< segments including the trailing text, or up to the first invalid one
+    size_t arg_count = 0;
+    bool valid = true;
+};
+
+/// Parse fmt in one pass; N must be at least format_segment_bound(fmt)
+template <size_t N>
+constexpr format_table<N> parse_format(const char* fmt)
+{
+    format_table<N> table{};
+    size_t pos = 0;
+    while (true) {
+        const format_segment seg = parse_segment(fmt, pos);
+        table.arg_index[table.count] = table.arg_count;
+        table.segments[table.count] = seg;
+        table.count += 1;
+        if (!seg.valid || !seg.conversion) {
+            table.valid = seg.valid;
+            return table;
+        }
+        table.arg_count += consumes_argument(seg.conversion) ? 1 : 0;
+    }
+}
+
+/// The parsed COMMON_FMT() literal Fmt, built once per format
+template <typename Fmt>
+struct parsed_format
+{
+    static constexpr format_table<format_segment_bound(Fmt::value())> table
+        = parse_format<format_segment_bound(Fmt::value())>(Fmt::value());
+};
+template <typename Fmt>
+constexpr format_table<format_segment_bound(Fmt::value())> parsed_format<Fmt>::table;
+
+template <char C>
+using conversion_tag = std::integral_constant<char, C>;
+
+constexpr char canonical_conversion(char c)
+{
+    return (c == 'i') ? 'd' : c;
+}
+
+template <typename Sink>
+void write_argument(Sink&, const format_segment&, conversion_tag<'\0'>) {}
+template <typename Sink>
+void write_argument(Sink& sink, const format_segment&, conversion_tag<'%'>)
+{
+    sink.append(common::string_view{"%"});
+}
+template <typename Sink, typename Arg>
+void write_argument(Sink& sink, const format_segment&, conversion_tag<'d'>, const Arg& arg)
+{
+    static_assert(std::is_integral<Arg>::value && !std::is_same<Arg, bool>::value, "%d/%i need an integer argument");
+    sink.append(common::integer_chars(arg).str());
+}
+/// The argument as printf() sees it for %u/%x: promoted as through varargs, then unsigned
+template <typename Arg>
+typename std::make_unsigned<decltype(+std::declval<Arg>())>::type as_unsigned(const Arg& arg)
+{
+    return typename std::make_unsigned<decltype(+arg)>::type(+arg);
+}
+template <typename Sink, typename Arg>
+void write_argument(Sink& sink, const format_segment&, conversion_tag<'u'>, const Arg& arg)
+{
+    static_assert(std::is_integral<Arg>::value && !std::is_same<Arg, bool>::value, "%u needs an integer argument");
+    sink.append(common::integer_chars(as_unsigned(arg)).str());
+}
+template <typename Sink, typename Arg>
+void write_argument(Sink& sink, const format_segment& seg, conversion_tag<'x'>, const Arg& arg)
+{
+    static_assert(std::is_integral<Arg>::value && !std::is_same<Arg, bool>::value, "%x needs an integer argument");
+    sink.append(common::hex_chars(uint64_t(as_unsigned(arg)), seg.width ? seg.width : 1).str());
+}
+/// %s of a null pointer prints "(null)", like glibc's printf()
+inline common::string_view string_argument(const char* str)
+{
+    return str ? common::string_view{str} : common::string_view{"(null)"};
+}
+inline common::string_view string_argument(char* str)
+{
+    return string_argument(static_cast<const char*>(str));
+}
+template <typename Arg>
+common::string_view string_argument(const Arg& arg)
+{
+    return common::string_view{arg};
+}
+template <typename Sink, typename Arg>
+void write_argument(Sink& sink, const format_segment&, conversion_tag<'s'>, const Arg& arg)
+{
+    static_assert(std::is_convertible<const Arg&, common::string_view>::value, "%s needs a string argument");
+    sink.append(string_argument(arg));
+}
+template <typename Sink, typename Arg>
+void write_argument(Sink& sink, const format_segment&, conversion_tag<'c'>, const Arg& arg)
+{
+    static_assert(std::is_same<Arg, char>::value, "%c needs a char argument");
+    sink.append(common::string_view{&arg, 1});
+}
+template <typename Sink, typename Arg>
+void write_argument(Sink& sink, const format_segment& seg, conversion_tag<'f'>, const Arg& arg)
+{
+    static_assert(std::is_floating_point<Arg>::value, "%f needs a floating point argument");
+    sink.append(common::double_chars(arg, seg.precision < 0 ? 6 : seg.precision).str());
+}
+
+template <typename Fmt, size_t K, typename Sink, typename Tuple>
+void write_segment(Sink& sink, const Tuple&, std::false_type /* consumes_argument */)
+{
+    constexpr format_segment seg = parsed_format<Fmt>::table.segments[K];
+    write_argument(sink, seg, conversion_tag<seg.conversion>{});
+}
+template <typename Fmt, size_t K, typename Sink, typename Tuple>
+void write_segment(Sink& sink, const Tuple& args, std::true_type /* consumes_argument */)
+{
+    constexpr format_segment seg = parsed_format<Fmt>::table.segments[K];
+    write_argument(sink, seg, conversion_tag<canonical_conversion(seg.conversion)>{},
+                   std::get<parsed_format<Fmt>::table.arg_index[K]>(args));
+}
+template <typename Fmt, size_t K, typename Sink, typename Tuple>
+void write_segment(Sink& sink, const Tuple& args)
+{
+    constexpr format_segment seg = parsed_format<Fmt>::table.segments[K];
+    if (seg.text_end != seg.text_begin)
+        sink.append(common::string_view{Fmt::value() + seg.text_begin, seg.text_end - seg.text_begin});
+    write_segment<Fmt, K>(sink, args, std::integral_constant<bool, consumes_argument(seg.conversion)>{});
+}
+template <typename Fmt, typename Sink, typename Tuple, size_t... K>
+void write_segments(Sink& sink, const Tuple& args, std::index_sequence<K...>)
+{
+    const int in_order[] = {0, (write_segment<Fmt, K>(sink, args), 0)...};
+    (void) in_order;
+}
+
+struct view_sink
+{
+    common::string_view_writeable remaining;
+    void append(common::string_view str)
+    {
+        remaining = remaining.write_advance(str);
+    }
+};
+
+} // namespace impl
+
+/**
+ * Formats into sink, which needs append(string_view), from a
+ * COMMON_FMT() literal parsed at compile time: the literal text
+ * is appended directly, each placeholder becomes a typed write,
+ * and mismatched argument counts or types fail to compile.
+ *
+ * Supports %d %i %u %x %0Nx %s %c %f %.Nf and %%.
+ */
+template <typename Sink, typename Fmt, typename... Args>
+Sink& static_format(Sink& sink, Fmt, const Args&... args)
+{
+    using parsed = impl::parsed_format<Fmt>;
+    static_assert(parsed::table.valid, "unsupported or malformed format string");
+    static_assert(parsed::table.arg_count == sizeof...(Args), "format string does not match the argument count");
+    impl::write_segments<Fmt>(sink, std::forward_as_tuple(args...), std::make_index_sequence<parsed::table.count>{});
+    return sink;
+}
+
+/// static_format() into a view, returning the unwritten remainder (not NUL terminated)
+template <typename Fmt, typename... Args>
+common::string_view_writeable static_format_advance(common::string_view_writeable to, Fmt fmt, const Args&... args)
+{
+    impl::view_sink sink{to};
+    static_format(sink, fmt, args...);
+    return sink.remaining;
+}
+
+} // namespace common
+
+#endif // COMMON_STATIC_FORMAT_HPP
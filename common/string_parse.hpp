@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_STRING_PARSE_HPP
+#define COMMON_STRING_PARSE_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <locale.h>
+#include <string>
+#include <type_traits>
+#include <strings.h>
+
+#if defined(__has_include) && __cplusplus >= 201703L
+#  if __has_include(<charconv>)
+#    include <charconv>
+#  endif
+#endif
+
+#include "common/common_result.hpp"
+
+namespace common
+{
+
+enum class parse_error
+{
+    empty,
+    invalid,
+    out_of_range,
+};
+
+inline const char* to_cstr(parse_error e)
+{
+    switch (e) {
+    case parse_error::empty:        return "empty input";
+    case parse_error::invalid:      return "invalid number";
+    case parse_error::out_of_range: return "number out of range";
+    }
+    return "unknown parse error";
+}
+inline std::string to_string(parse_error e) { return to_cstr(e); }
+
+namespace impl
+{
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define COMMON_PARSE_SWAR 1
+#endif
+
+#ifdef COMMON_PARSE_SWAR
+inline uint64_t load_eight(const char* p)
+{
+    uint64_t v;
+    ::memcpy(&v, p, sizeof(v));
+    return v;
+}
+inline bool is_eight_digits(uint64_t v)
+{
+    return ((v & 0xF0F0F0F0F0F0F0F0ull) == 0x3030303030303030ull)
+        && (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) == 0x3030303030303030ull);
+}
+/// Eight ASCII digits (first digit in the lowest byte) to their value
+inline uint32_t parse_eight_digits(uint64_t v)
+{
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+       + (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return uint32_t(v);
+}
+#endif
+
+inline bool is_digit(char c)
+{
+    return unsigned(c - '0') < 10;
+}
+
+/**
+ * Accumulates decimal digits from p into value, eight
+ * at a time where possible, stopping at the first
+ * non-digit or once max_digits have been read.
+ */
+inline const char* parse_digits(const char* p, const char* end, uint64_t& value, size_t max_digits)
+{
+    const char* const limit = (size_t(end - p) > max_digits) ? p + max_digits : end;
+#ifdef COMMON_PARSE_SWAR
+    while (limit - p >= 8) {
+        const uint64_t chunk = load_eight(p);
+        if (!is_eight_digits(chunk))
+            break;
+        value = value * 100000000 + parse_eight_digits(chunk);
+        p += 8;
+    }
+#endif
+    for (; p != limit && is_digit(*p); ++p)
+        value = value * 10 + unsigned(*p - '0');
+    return p;
+}
+
+template <typename T>
+result<T, parse_error> parse_integer(const char* p, const char* end)
+{
+    using unsigned_type = typename std::make_unsigned<T>::type;
+    if (p == end)
+        return parse_error::empty;
+    const bool negative = std::is_signed<T>::value && (*p == '-');
+    if (negative)
+        p += 1;
+    if (p == end || !is_digit(*p))
+        return parse_error::invalid;
+    while (p != end && *p == '0')
+        p += 1;
+
+    // 19 digits always fit in uint64_t, a 20th needs checking
+    uint64_t magnitude = 0;
+    const char* digits_end = parse_digits(p, end, magnitude, 19);
+    if (digits_end != end && is_digit(*digits_end)) {
+        const unsigned last = unsigned(*digits_end - '0');
+        if (magnitude > (std::numeric_limits<uint64_t>::max() - last) / 10)
+            return parse_error::out_of_range;
+        magnitude = magnitude * 10 + last;
+        digits_end += 1;
+        if (digits_end != end && is_digit(*digits_end))
+            return parse_error::out_of_range;
+    }
+    if (digits_end != end)
+        return parse_error::invalid;
+
+    const uint64_t max_magnitude = uint64_t(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+    if (magnitude > max_magnitude)
+        return parse_error::out_of_range;
+    if (negative)
+        return T(unsigned_type(0) - unsigned_type(magnitude));
+    return T(magnitude);
+}
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+template <typename T>
+result<T, parse_error> parse_float(const char* p, const char* end)
+{
+    if (p == end)
+        return parse_error::empty;
+    T value{};
+    const std::from_chars_result res = std::from_chars(p, end, value);
+    if (res.ptr != end)
+        return parse_error::invalid;
+    if (res.ec == std::errc::result_out_of_range)
+        return parse_error::out_of_range;
+    if (res.ec != std::errc{})
+        return parse_error::invalid;
+    return value;
+}
+#else
+inline double exact_power_of_ten(int exponent)
+{
+    static const double powers[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    return powers[exponent];
+}
+#if defined(__GLIBC__)
+/// The "C" locale, so a process-wide LC_NUMERIC cannot change the decimal point
+inline locale_t c_numeric_locale()
+{
+    static const locale_t locale = ::newlocale(LC_NUMERIC_MASK, "C", locale_t(0));
+    return locale;
+}
+inline float strto(const char* str, char** end, float*) { return ::strtof_l(str, end, c_numeric_locale()); }
+inline double strto(const char* str, char** end, double*) { return ::strtod_l(str, end, c_numeric_locale()); }
+inline long double strto(const char* str, char** end, long double*) { return ::strtold_l(str, end, c_numeric_locale()); }
+#else
+inline float strto(const char* str, char** end, float*) { return ::strtof(str, end); }
+inline double strto(const char* str, char** end, double*) { return ::strtod(str, end); }
+inline long double strto(const char* str, char** end, long double*) { return ::strtold(str, end); }
+#endif
+
+enum { FLOAT_MAX_DIGITS = 800, FLOAT_MAX_EXPONENT = 100000 };
+
+/**
+ * Rewrites a validated decimal number as sign, at most FLOAT_MAX_DIGITS
+ * significant digits and an exponent clamped to FLOAT_MAX_EXPONENT,
+ * writing at most FLOAT_MAX_DIGITS + 16 chars including the terminator,
+ * or returning 0 for a malformed exponent.
+ * Dropped non-zero digits leave a trailing sticky 1: no rounding boundary
+ * of a float, double or long double has that many digits, so strtod()
+ * rounds the result exactly as it would the original.
+ */
+inline size_t compact_float(const char* p, const char* end, char* out)
+{
+    char* o = out;
+    if (p != end && *p == '-')
+        *o++ = *p++;
+    int64_t exponent_adjust = 0;
+    size_t kept = 0;
+    bool sticky = false;
+    bool in_fraction = false;
+    for (; p != end && (is_digit(*p) || *p == '.'); ++p) {
+        if (*p == '.') {
+            in_fraction = true;
+        } else if (kept == 0 && *p == '0') {
+            exponent_adjust -= in_fraction;
+        } else if (kept < FLOAT_MAX_DIGITS) {
+            o[kept++] = *p;
+            exponent_adjust -= in_fraction;
+        } else {
+            sticky = sticky || (*p != '0');
+            exponent_adjust += !in_fraction;
+        }
+    }
+    if (kept == 0)
+        o[kept++] = '0';
+    if (sticky) {
+        o[kept++] = '1';
+        exponent_adjust -= 1;
+    }
+    o += kept;
+    int64_t exponent = 0;
+    if (p != end) {
+        if (*p != 'e' && *p != 'E')
+            return 0;
+        p += 1;
+        const bool negative = (p != end && *p == '-');
+        if (p != end && (*p == '-' || *p == '+'))
+            p += 1;
+        if (p == end)
+            return 0;
+        for (; p != end; ++p) {
+            if (!is_digit(*p))
+                return 0;
+            exponent = std::min<int64_t>(exponent * 10 + (*p - '0'), 4 * FLOAT_MAX_EXPONENT);
+        }
+        if (negative)
+            exponent = -exponent;
+    }
+    exponent = std::max<int64_t>(-FLOAT_MAX_EXPONENT, std::min<int64_t>(FLOAT_MAX_EXPONENT, exponent + exponent_adjust));
+    *o++ = 'e';
+    if (exponent < 0) {
+        *o++ = '-';
+        exponent = -exponent;
+    }
+    char digits[8];
+    int count = 0;
+    do {
+        digits[count++] = char('0' + exponent % 10);
+        exponent /= 10;
+    } while (exponent);
+    while (count)
+        *o++ = digits[--count];
+    *o = '\0';
+    return size_t(o - out);
+}
+
+/**
+ * strtod() needs a terminated string: short input is copied as is and
+ * long input compacted, both on the stack. Underflow to zero and
+ * overflow are out_of_range, subnormal results are accepted, all as
+ * with from_chars().
+ */
+template <typename T>
+result<T, parse_error> parse_float_strtod(const char* begin, const char* end)
+{
+    char buf[FLOAT_MAX_DIGITS + 16];
+    const size_t len = end - begin;
+    size_t str_len = len;
+    if (len < 128) {
+        ::memcpy(buf, begin, len);
+        buf[len] = '\0';
+    } else {
+        str_len = compact_float(begin, end, buf);
+        if (!str_len)
+            return parse_error::invalid;
+    }
+    char* parsed_end = nullptr;
+    errno = 0;
+    const T value = strto(buf, &parsed_end, static_cast<T*>(nullptr));
+    if (parsed_end != buf + str_len)
+        return parse_error::invalid;
+    if (errno == ERANGE && (value == 0 || value == std::numeric_limits<T>::infinity() || value == -std::numeric_limits<T>::infinity()))
+        return parse_error::out_of_range;
+    return value;
+}
+inline bool is_float_word(const char* p, const char* end)
+{
+    static const char* const words[] = {"inf", "infinity", "nan"};
+    for (const char* word : words)
+        if (size_t(end - p) == ::strlen(word) && ::strncasecmp(p, word, end - p) == 0)
+            return true;
+    return false;
+}
+
+/**
+ * Validates the number with from_chars() syntax, then converts
+ * exactly when the significand and exponent are small enough for
+ * a single correctly-rounded multiply or divide, else via strtod().
+ */
+template <typename T>
+result<T, parse_error> parse_float(const char* const begin, const char* const end)
+{
+    if (begin == end)
+        return parse_error::empty;
+    const char* p = begin;
+    const bool negative = (*p == '-');
+    if (negative)
+        p += 1;
+
+    uint64_t significand = 0;
+    const char* const int_begin = p;
+    while (p != end && *p == '0')
+        p += 1;
+    const char* const significant_begin = p;
+    p = parse_digits(p, end, significand, 19);
+    bool exact = !(p != end && is_digit(*p));
+    while (p != end && is_digit(*p))
+        p += 1;
+    size_t digits = p - significant_begin;
+    const bool has_int = (p != int_begin);
+
+    int exponent = 0;
+    bool has_frac = false;
+    if (p != end && *p == '.') {
+        p += 1;
+        const char* const frac_begin = p;
+        if (!digits)
+            while (p != end && *p == '0')
+                p += 1;
+        const char* const frac_digits = p;
+        if (exact)
+            p = parse_digits(p, end, significand, 19 - digits);
+        exact = exact && !(p != end && is_digit(*p));
+        exponent -= int(p - frac_digits) + int(frac_digits - frac_begin);
+        digits += p - frac_digits;
+        while (p != end && is_digit(*p))
+            p += 1;
+        has_frac = (p != frac_begin);
+    }
+    if (!has_int && !has_frac)
+        return is_float_word(begin + negative, end) ? parse_float_strtod<T>(begin, end) : parse_error::invalid;
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        p += 1;
+        const bool negative_exponent = (p != end && *p == '-');
+        if (p != end && (*p == '-' || *p == '+'))
+            p += 1;
+        if (p == end || !is_digit(*p))
+            return parse_error::invalid;
+        uint64_t explicit_exponent = 0;
+        const char* exp_end = parse_digits(p, end, explicit_exponent, 9);
+        if (exp_end != end)
+            return (is_digit(*exp_end)) ? parse_float_strtod<T>(begin, end) : parse_error::invalid;
+        p = exp_end;
+        exponent += negative_exponent ? -int(explicit_exponent) : int(explicit_exponent);
+    }
+    if (p != end)
+        return parse_error::invalid;
+
+    // Both the significand and power of ten are exact in T,
+    // so one multiply or divide gives the correctly rounded value
+    const bool single_precision = std::numeric_limits<T>::digits < 53;
+    const uint64_t max_exact_significand = uint64_t(1) << (single_precision ? 24 : 53);
+    const int max_exact_exponent = single_precision ? 10 : 22;
+    if (exact && significand <= max_exact_significand
+              && exponent >= -max_exact_exponent && exponent <= max_exact_exponent) {
+        T value = T(significand);
+        const T power = T(exact_power_of_ten(exponent < 0 ? -exponent : exponent));
+        value = (exponent < 0) ? value / power : value * power;
+        return negative ? -value : value;
+    }
+    return parse_float_strtod<T>(begin, end);
+}
+#endif
+
+} // namespace impl
+
+namespace impl
+{
+template <typename T>
+result<T, parse_error> parse_number(const char* begin, const char* end, std::true_type /* is_integral */)
+{
+    return parse_integer<T>(begin, end);
+}
+template <typename T>
+result<T, parse_error> parse_number(const char* begin, const char* end, std::false_type /* is_integral */)
+{
+    return parse_float<T>(begin, end);
+}
+} // namespace impl
+
+/**
+ * Parse all of [begin, end) as a number, with the syntax of
+ * std::from_chars(): an optional '-', no '+', whitespace or
+ * base prefixes. Nothing is allocated and the locale is ignored
+ * (before C++17, outside glibc, floats follow LC_NUMERIC).
+ */
+template <typename T>
+result<T, parse_error> parse_number(const char* begin, const char* end)
+{
+    static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value, "only integer and floating-point types can be parsed");
+    return impl::parse_number<T>(begin, end, std::is_integral<T>{});
+}
+
+} // namespace common
+
+#endif // COMMON_STRING_PARSE_HPP
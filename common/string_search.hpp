@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_STRING_SEARCH_HPP
+#define COMMON_STRING_SEARCH_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#ifdef _WIN32
+#include <algorithm>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if !defined(COMMON_NO_SIMD) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+
+namespace common
+{
+namespace impl
+{
+
+#if !defined(COMMON_NO_SIMD) && defined(__AVX2__)
+#define COMMON_SIMD_AVX2 1
+#endif
+#if !defined(COMMON_NO_SIMD) && defined(__SSE2__)
+#define COMMON_SIMD_SSE2 1
+#endif
+
+/// Index of the lowest set bit, mask must not be 0
+inline unsigned count_trailing_zeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return unsigned(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+/**
+ * A precomputed set of bytes to search for,
+ * as used by splitter::any_char().
+ *
+ * Small sets (the common " \t\r\n," case) are
+ * matched 16/32 bytes at a time with SSE2/AVX2
+ * compares when built with those enabled, anything
+ * else falls back to a 256-bit membership table,
+ * which is still one load per byte rather than
+ * a memchr() over the set per byte.
+ *
+ * Define COMMON_NO_SIMD to force the table path.
+ */
+struct byte_set
+{
+    enum { MAX_VECTOR_CHARS = 16 };
+
+    uint64_t table[4] = {0, 0, 0, 0};
+    uint8_t chars[MAX_VECTOR_CHARS] = {};
+    size_t count = 0;
+
+    byte_set() = default;
+    byte_set(const void* pattern, size_t len)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(pattern);
+        for (size_t i = 0; i < len; ++i) {
+            if (contains(p[i]))
+                continue;
+            table[p[i] >> 6] |= uint64_t(1) << (p[i] & 63);
+            if (count < MAX_VECTOR_CHARS)
+                chars[count] = p[i];
+            count += 1;
+        }
+    }
+
+    bool contains(uint8_t c) const
+    {
+        return (table[c >> 6] >> (c & 63)) & 1;
+    }
+    bool vectorisable() const
+    {
+        return count <= MAX_VECTOR_CHARS;
+    }
+
+    /// First byte in [begin, end) which is in the set, or nullptr
+    const char* find(const char* begin, const char* end) const
+    {
+        if (!count)
+            return nullptr;
+        const char* p = begin;
+        if (count == 1)
+            return static_cast<const char*>(::memchr(p, chars[0], end - p));
+#ifdef COMMON_SIMD_AVX2
+        if (vectorisable()) {
+            for (; end - p >= 32; p += 32) {
+                const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                __m256i hits = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(chars[0]));
+                for (size_t i = 1; i < count; ++i)
+                    hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(chars[i])));
+                const uint32_t mask = _mm256_movemask_epi8(hits);
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+        }
+#endif
+#ifdef COMMON_SIMD_SSE2
+        if (vectorisable()) {
+            for (; end - p >= 16; p += 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                __m128i hits = _mm_cmpeq_epi8(block, _mm_set1_epi8(chars[0]));
+                for (size_t i = 1; i < count; ++i)
+                    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8(chars[i])));
+                const uint32_t mask = _mm_movemask_epi8(hits);
+                if (mask)
+                    return p + count_trailing_zeros(mask);
+            }
+        }
+#endif
+        for (; p != end; ++p)
+            if (contains(uint8_t(*p)))
+                return p;
+        return nullptr;
+    }
+};
+
+/**
+ * A substring search for a fixed needle, as used
+ * by splitter::string() and find_opt().
+ *
+ * Unlike memmem() there is no per-call analysis of
+ * the needle: candidates are filtered on the first
+ * and last bytes of the needle (32/16 positions at
+ * a time with AVX2/SSE2, memchr() otherwise) and
+ * only then compared in full, which suits the short
+ * separators (\r\n, " | ") used for splitting.
+ *
+ * Each candidate costs up to a needle-length compare,
+ * so needles longer than MAX_FILTERED_LEN go to the
+ * linear-time memmem() (std::search() on Windows)
+ * to keep periodic needles ("aaa...ab") from going
+ * quadratic.
+ *
+ * The needle is referenced, not copied.
+ */
+struct substring_searcher
+{
+    enum { MAX_FILTERED_LEN = 32 };
+
+    const char* needle = nullptr;
+    size_t len = 0;
+
+    substring_searcher() = default;
+    substring_searcher(const void* pattern, size_t len)
+    : needle(static_cast<const char*>(pattern)), len(len)
+    {}
+
+    /// First occurrence of the needle in [begin, end), or nullptr
+    const char* find(const char* begin, const char* end) const
+    {
+        if (!len)
+            return begin;
+        if (size_t(end - begin) < len)
+            return nullptr;
+        if (len == 1)
+            return static_cast<const char*>(::memchr(begin, needle[0], end - begin));
+        if (len > MAX_FILTERED_LEN)
+            return find_long(begin, end);
+        const char* p = begin;
+        // Last position a match may start at
+        const char* const last_start = end - len;
+#ifdef COMMON_SIMD_AVX2
+        {
+            const __m256i first_byte = _mm256_set1_epi8(needle[0]);
+            const __m256i last_byte = _mm256_set1_epi8(needle[len - 1]);
+            for (; last_start - p >= 32; p += 32) {
+                const __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                const __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + len - 1));
+                uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first_byte),
+                                                                      _mm256_cmpeq_epi8(block_last, last_byte)));
+                for (; mask; mask &= mask - 1) {
+                    const char* candidate = p + count_trailing_zeros(mask);
+                    if (::memcmp(candidate + 1, needle + 1, len - 2) == 0)
+                        return candidate;
+                }
+            }
+        }
+#endif
+#ifdef COMMON_SIMD_SSE2
+        {
+            const __m128i first_byte = _mm_set1_epi8(needle[0]);
+            const __m128i last_byte = _mm_set1_epi8(needle[len - 1]);
+            for (; last_start - p >= 16; p += 16) {
+                const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + len - 1));
+                uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first_byte),
+                                                                _mm_cmpeq_epi8(block_last, last_byte)));
+                for (; mask; mask &= mask - 1) {
+                    const char* candidate = p + count_trailing_zeros(mask);
+                    if (::memcmp(candidate + 1, needle + 1, len - 2) == 0)
+                        return candidate;
+                }
+            }
+        }
+#endif
+        while (p <= last_start) {
+            p = static_cast<const char*>(::memchr(p, needle[0], last_start - p + 1));
+            if (!p)
+                return nullptr;
+            if (p[len - 1] == needle[len - 1] && ::memcmp(p + 1, needle + 1, len - 2) == 0)
+                return p;
+            p += 1;
+        }
+        return nullptr;
+    }
+
+private:
+    const char* find_long(const char* begin, const char* end) const
+    {
+#ifndef _WIN32
+        return static_cast<const char*>(::memmem(begin, end - begin, needle, len));
+#else
+        const char* found = std::search(begin, end, needle, needle + len);
+        return found == end ? nullptr : found;
+#endif
+    }
+};
+
+/**
+ * Writes the offset (from base_offset) of each c in
+ * [begin, end) to out, stopping once max_out are
+ * written, and returns the number written.
+ *
+ * Blocks are compared with AVX2/SSE2 and the hits
+ * extracted from the bitmask, so dense delimiters
+ * cost a few instructions each instead of a call.
+ */
+template <typename Offset>
+size_t index_byte(const char* begin, const char* end, char c, Offset* out, size_t max_out, size_t base_offset)
+{
+    size_t written = 0;
+    const char* p = begin;
+#if defined(COMMON_SIMD_AVX2) || defined(COMMON_SIMD_SSE2)
+    auto add_hits = [&] (uint32_t mask) {
+        for (; mask && written < max_out; mask &= mask - 1)
+            out[written++] = Offset(base_offset + (p - begin) + count_trailing_zeros(mask));
+    };
+#endif
+#ifdef COMMON_SIMD_AVX2
+    const __m256i c32 = _mm256_set1_epi8(c);
+    for (; end - p >= 32 && written < max_out; p += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        add_hits(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, c32)));
+    }
+#endif
+#ifdef COMMON_SIMD_SSE2
+    const __m128i c16 = _mm_set1_epi8(c);
+    for (; end - p >= 16 && written < max_out; p += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        add_hits(_mm_movemask_epi8(_mm_cmpeq_epi8(block, c16)));
+    }
+#endif
+    for (; p != end && written < max_out; ++p)
+        if (*p == c)
+            out[written++] = Offset(base_offset + (p - begin));
+    return written;
+}
+
+} // namespace impl
+} // namespace common
+
+#endif // COMMON_STRING_SEARCH_HPP
@@ -26,10 +26,13 @@
 #include "common/array_view.hpp"
 #include "common/common_optional.hpp"
 #include "common/shared_defines.hpp"
+#include "common/string_parse.hpp"
+#include "common/string_search.hpp"
 
 #include <string>
 #include <algorithm>
 #include <cstring>
+#include <limits>
 
 #include <stdarg.h>
 
@@ -197,6 +200,61 @@ struct basic_string_view : public array_view<T>
         return count;
     }
 
+    /**
+     * Bulk index the positions of c from `from` onwards into
+     * offsets, returning how many were written. When it comes
+     * back full, resume from offsets[count - 1] + 1.
+     *
+     * Offsets are relative to data() and must fit in Offset.
+     */
+    template <typename Offset>
+    size_t index_of(T c, array_view<Offset> offsets, size_t from = 0) const
+    {
+        static_assert(sizeof(T) == 1, "index_of is only supported on byte strings");
+        static_assert(std::is_integral<Offset>::value && std::is_unsigned<Offset>::value, "offsets must be unsigned integers");
+        if (from >= size())
+            return 0;
+        const char* begin = reinterpret_cast<const char*>(data());
+        return impl::index_byte(begin + from, begin + size(), char(c), offsets.data(), offsets.size(), from);
+    }
+    /**
+     * Equivalent to split_fn(c, fn), but finds separators in
+     * bulk through index_of() with scratch as the offset table,
+     * which is much faster for many short tokens (lines).
+     */
+    template <typename Offset, class Fn>
+    size_t split_fn_indexed(T c, array_view<Offset> scratch, Fn&& fn) const
+    {
+        if (scratch.empty())
+            return split_fn(c, std::forward<Fn>(fn));
+        // Index in windows so offsets always fit in Offset
+        const size_t window_size = std::numeric_limits<Offset>::max();
+        size_t count = 0;
+        size_t start = 0;
+        size_t from = 0;
+        while (from < size()) {
+            const basic_string_view window = advance(from).head(window_size);
+            const size_t found = window.index_of(c, scratch);
+            for (size_t i = 0; i < found; ++i) {
+                const size_t pos = from + scratch[i];
+                if (pos != start) {
+                    fn(basic_string_view{data() + start, data() + pos});
+                    count += 1;
+                }
+                start = pos + 1;
+            }
+            if (found == scratch.size())
+                from += size_t(scratch[found - 1]) + 1;
+            else
+                from += window.size();
+        }
+        if (start < size()) {
+            fn(basic_string_view{data() + start, this->end()});
+            count += 1;
+        }
+        return count;
+    }
+
     enum split_flag
     {
         none              = 0x00,
@@ -213,9 +271,13 @@ struct basic_string_view : public array_view<T>
     template <pattern_type P>
     struct split_def_long_base
     {
+        using searcher_type = typename std::conditional<P == pattern_type::any_char, impl::byte_set, impl::substring_searcher>::type;
         basic_string_view pattern;
         split_flag flags;
-        split_def_long_base(basic_string_view p, split_flag flags = none) : pattern{p}, flags{flags} {}
+        searcher_type searcher;
+        split_def_long_base(basic_string_view p, split_flag flags = none)
+        : pattern{p}, flags{flags}, searcher{p.data(), p.size() * sizeof(T)}
+        {}
     };
     template <typename Fn>
     size_t split_fn(split_def def, Fn&& fn) const
@@ -235,6 +297,8 @@ struct basic_string_view : public array_view<T>
     using split_def_any_char = split_def_long_base<pattern_type::any_char>;
     struct splitter {
         using flag = split_flag;
+        /// The returned splitter holds a prebuilt searcher,
+        /// keep it around to reuse for repeated splits/finds
         static split_def_string string(basic_string_view pattern, split_flag flags = split_flag::none)
         {
             return split_def_string{pattern, flags};
@@ -254,23 +318,18 @@ struct basic_string_view : public array_view<T>
     }
     const T* find_in(const split_def_string& def) const
     {
-#ifndef _WIN32
-        const T* res = (const T*) ::memmem(data(), size() * sizeof(T), def.pattern.data(), def.pattern.size() * sizeof(T));
-#else
-        const T* res = std::search(this->begin(), this->end(), def.pattern.begin(), def.pattern.end());
-        if (res == this->end())
-            return nullptr;
-#endif
-        return res;
+        return find_with(def.searcher);
+    }
+    const T* find_with(const impl::substring_searcher& searcher) const
+    {
+        const char* begin = reinterpret_cast<const char*>(data());
+        return reinterpret_cast<const T*>(searcher.find(begin, begin + size() * sizeof(T)));
     }
     const T* find_in(const split_def_any_char& def) const
     {
-        auto it = std::find_if(this->begin(), this->end(), [&def] (T chr) {
-            return ::memchr(def.pattern.data(), chr, def.pattern.size()) != nullptr;
-        });
-        if (it != this->end())
-            return &*it;
-        return nullptr;
+        static_assert(sizeof(T) == 1, "any_char splitting is only supported on byte strings");
+        const char* begin = reinterpret_cast<const char*>(data());
+        return reinterpret_cast<const T*>(def.searcher.find(begin, begin + size()));
     }
     const T* find_in(const split_def& def) const
     {
@@ -331,6 +390,106 @@ struct basic_string_view : public array_view<T>
         return split_args_any<decltype(splitter)>(splitter, arg, args...);
     }
 
+    /**
+     * A lazily evaluated range of the tokens from split(),
+     * each increment only searches as far as the next separator.
+     *
+     *   for (string_view field : line.split(','))
+     *       if (handle(field) == done) break;
+     */
+    template <class S>
+    struct split_range
+    {
+        struct iterator
+        {
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = basic_string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const basic_string_view*;
+            using reference = const basic_string_view&;
+
+            S splitter;
+            basic_string_view token;
+            basic_string_view remaining;
+            size_t tokens_left = 0;
+            bool has_remaining = false;
+            bool at_end = true;
+
+            explicit iterator(S splitter) : splitter(std::move(splitter)) {}
+            iterator(S splitter, basic_string_view source, size_t max_tokens)
+            : splitter(std::move(splitter)), remaining(source), tokens_left(max_tokens), has_remaining(true)
+            {
+                next();
+            }
+
+            reference operator*() const { return token; }
+            pointer operator->() const { return &token; }
+            iterator& operator++() { next(); return *this; }
+            iterator operator++(int) { iterator prev = *this; next(); return prev; }
+
+            bool operator==(const iterator& other) const
+            {
+                if (at_end || other.at_end)
+                    return at_end == other.at_end;
+                return token.data() == other.token.data() && token.size() == other.token.size();
+            }
+            bool operator!=(const iterator& other) const { return !(*this == other); }
+
+            /// The unsplit input following the current token
+            basic_string_view rest() const
+            {
+                return has_remaining ? remaining : basic_string_view{remaining.end(), remaining.end()};
+            }
+
+        private:
+            void next()
+            {
+                if (!tokens_left || !has_remaining) {
+                    at_end = true;
+                    return;
+                }
+                at_end = false;
+                do {
+                    const T* pos = remaining.find_in(splitter);
+                    if (!pos) {
+                        token = remaining;
+                        has_remaining = false;
+                    } else {
+                        token = basic_string_view{remaining.begin(), pos};
+                        remaining = {pos + pattern_length(splitter), remaining.end()};
+                    }
+                } while (token.empty() && (splitter.flags & skip_empty) && has_remaining);
+                if (token.empty() && (splitter.flags & skip_empty)) {
+                    at_end = true;
+                    return;
+                }
+                tokens_left -= 1;
+                if (!tokens_left && (splitter.flags & last_captures_all)) {
+                    token = basic_string_view{token.begin(), remaining.end()};
+                    has_remaining = false;
+                }
+            }
+        };
+
+        S splitter;
+        basic_string_view source;
+        size_t max_tokens;
+
+        iterator begin() const { return iterator{splitter, source, max_tokens}; }
+        iterator end() const { return iterator{splitter}; }
+    };
+    /// Split into at most max_tokens tokens, with
+    /// last_captures_all the final one takes the remainder
+    split_range<split_def> split(split_def splitter, size_t max_tokens = size_t(-1)) const
+    {
+        return split_range<split_def>{splitter, *this, max_tokens};
+    }
+    template <pattern_type P>
+    split_range<split_def_long_base<P>> split(split_def_long_base<P> splitter, size_t max_tokens = size_t(-1)) const
+    {
+        return split_range<split_def_long_base<P>>{std::move(splitter), *this, max_tokens};
+    }
+
     common::optional<size_t> rsplit_arg_single(T c, basic_string_view& arg) const
     {
 #ifdef _GNU_SOURCE
@@ -379,17 +538,19 @@ struct basic_string_view : public array_view<T>
     }
     common::optional<basic_string_view> find_opt_str(basic_string_view<const_type> needle) const
     {
-#ifndef _WIN32
-        void* found = ::memmem(static_cast<const void*>(data()),        size()        * sizeof(T),
-                               static_cast<const void*>(needle.data()), needle.size() * sizeof(T));
+        return find_opt_str_with(impl::substring_searcher{needle.data(), needle.size() * sizeof(T)});
+    }
+    /// Search with a prebuilt splitter::string(), when the same needle is used repeatedly
+    common::optional<basic_string_view> find_opt_str(const split_def_string& def) const
+    {
+        return find_opt_str_with(def.searcher);
+    }
+    common::optional<basic_string_view> find_opt_str_with(const impl::substring_searcher& searcher) const
+    {
+        const T* found = find_with(searcher);
         if (!found)
             return common::none{};
-#else
-        T* found = std::search(this->begin(), this->end(), needle.begin(), needle.end());
-        if (found == this->end())
-            return common::none{};
-#endif
-        return basic_string_view{static_cast<T*>(found), this->end()};
+        return basic_string_view{const_cast<T*>(found), this->end()};
     }
     common::optional<size_t> find_opt(basic_string_view<const_type> needle) const
     {
@@ -398,11 +559,30 @@ struct basic_string_view : public array_view<T>
             return common::none{};
         return found->data() - data();
     }
+    common::optional<size_t> find_opt(const split_def_string& def) const
+    {
+        auto found = find_opt_str(def);
+        if (!found)
+            return common::none{};
+        return found->data() - data();
+    }
     enum : size_t { npos = size_t(-1) };
     size_t find(basic_string_view<const_type> needle) const
     {
         return find_opt(needle).get_or(npos);
     }
+    size_t find(const split_def_string& def) const
+    {
+        return find_opt(def).get_or(npos);
+    }
+    /// The whole view as a number, see common::parse_number()
+    template <typename U>
+    result<U, parse_error> parse() const
+    {
+        static_assert(sizeof(T) == 1, "parse is only supported on byte strings");
+        const char* begin = reinterpret_cast<const char*>(data());
+        return parse_number<U>(begin, begin + size());
+    }
     common::optional<size_t> find_char(T c) const
     {
         const T* pos = (const T*) memchr(data(), c, size());
@@ -430,6 +610,15 @@ struct basic_string_view : public array_view<T>
         return file;
     }
 
+    /// Copy as much of str as fits, returning the view after it
+    template <typename = typename std::enable_if<!std::is_const<T>::value>>
+    basic_string_view write_advance(basic_string_view<const_type> str) const
+    {
+        const size_t count = std::min(str.size(), size());
+        if (count)
+            ::memcpy(data(), str.data(), count * sizeof(T));
+        return advance(count);
+    }
     template <typename = typename std::enable_if<!std::is_const<T>::value>>
     int formatv(const char* format_string, va_list args) const
     {
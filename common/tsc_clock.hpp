@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2018 Starship Technologies, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMMON_TSC_CLOCK_HPP
+#define COMMON_TSC_CLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <ctime>
+
+// rdtsc exists on i386 too, but is left to the CLOCK_MONOTONIC fallback there
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define COMMON_HAVE_TSC 1
+#endif
+
+#include "common_timestamp.hpp"
+
+namespace common
+{
+
+namespace impl
+{
+
+/// (value * factor_q32) >> 32 for a 32.32 fixed-point factor
+inline int64_t mul_q32(int64_t value, uint64_t factor_q32)
+{
+#ifdef __SIZEOF_INT128__
+    return int64_t((__int128(value) * factor_q32) >> 32);
+#else
+    const uint64_t magnitude = value < 0 ? 0 - uint64_t(value) : uint64_t(value);
+    const uint64_t a_lo = magnitude & 0xffffffffu, a_hi = magnitude >> 32;
+    const uint64_t b_lo = factor_q32 & 0xffffffffu, b_hi = factor_q32 >> 32;
+    const uint64_t scaled = ((a_hi * b_hi) << 32) + a_hi * b_lo + a_lo * b_hi + ((a_lo * b_lo) >> 32);
+    return value < 0 ? -int64_t(scaled) : int64_t(scaled);
+#endif
+}
+
+/// (value << 32) / divisor, truncated to 64 bits
+inline uint64_t div_q32(uint64_t value, uint64_t divisor)
+{
+#ifdef __SIZEOF_INT128__
+    return uint64_t(((unsigned __int128)value << 32) / divisor);
+#else
+    uint64_t quotient = value / divisor;
+    uint64_t remainder = value % divisor;
+    for (int bit = 0; bit < 32; ++bit) {
+        const bool carry = remainder >> 63;
+        remainder <<= 1;
+        quotient <<= 1;
+        if (carry || remainder >= divisor) {
+            remainder -= divisor;
+            quotient |= 1;
+        }
+    }
+    return quotient;
+#endif
+}
+
+} // namespace impl
+
+/**
+ * A raw tsc_clock reading: store these in hot loops and convert
+ * only when the value is kept or printed.
+ */
+struct tsc_stamp
+{
+    uint64_t ticks = 0;
+
+    timestamp to_timestamp() const;
+    timestamp to_monotonic() const;
+};
+
+/**
+ * A cycle-counter clock: reading it is an rdtsc of a few ns instead of
+ * a clock_gettime() of ~20 ns. Ticks are converted to nanoseconds with
+ * a rate calibrated against CLOCK_MONOTONIC at construction, and again
+ * whenever a conversion finds the last calibration older than
+ * recalibrate_after. Each recalibration re-anchors the conversion to
+ * CLOCK_MONOTONIC, so drift stays bounded by the rate error over one
+ * interval.
+ *
+ * Assumes an invariant TSC, synchronised across cores (invariant_tsc()
+ * reports it). Without rdtsc the ticks are CLOCK_MONOTONIC nanoseconds.
+ */
+struct tsc_clock
+{
+    struct sample
+    {
+        uint64_t ticks;
+        uint64_t mono_ns;
+    };
+
+    std::chrono::nanoseconds recalibrate_after = std::chrono::seconds(1);
+
+    tsc_clock(const tsc_clock&) = delete;
+    tsc_clock& operator=(const tsc_clock&) = delete;
+
+    /// Calibrate over calibration_time; longer gives a more accurate initial rate
+    explicit tsc_clock(std::chrono::milliseconds calibration_time = std::chrono::milliseconds(20))
+    {
+        anchor = take_sample();
+        std::this_thread::sleep_for(calibration_time);
+        publish(anchor, take_sample());
+    }
+
+    /// The process-wide clock, calibrated on first use
+    static tsc_clock& global()
+    {
+        static tsc_clock clock;
+        return clock;
+    }
+
+    static uint64_t ticks()
+    {
+#ifdef COMMON_HAVE_TSC
+        return __rdtsc();
+#else
+        return monotonic_ns();
+#endif
+    }
+    /// ticks() once all earlier instructions have executed
+    static uint64_t ticks_ordered()
+    {
+#ifdef COMMON_HAVE_TSC
+        unsigned aux;
+        return __rdtscp(&aux);
+#else
+        return monotonic_ns();
+#endif
+    }
+    static tsc_stamp now()
+    {
+        return tsc_stamp{ticks()};
+    }
+
+    static bool invariant_tsc()
+    {
+#ifdef COMMON_HAVE_TSC
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+            return false;
+        return (edx & (1u << 8)) != 0;
+#else
+        return true;
+#endif
+    }
+
+    /// CLOCK_MONOTONIC nanoseconds at ticks
+    uint64_t to_monotonic_ns(uint64_t at_ticks)
+    {
+        return convert(current(at_ticks), at_ticks);
+    }
+    timestamp to_monotonic(uint64_t at_ticks)
+    {
+        return timestamp::from_nanos(to_monotonic_ns(at_ticks));
+    }
+    /// Wall-clock (CLOCK_REALTIME) timestamp at ticks
+    timestamp to_timestamp(uint64_t at_ticks)
+    {
+        // The offset comes from the same calibration as the rate, so both match
+        const params p = current(at_ticks);
+        return timestamp::from_nanos(convert(p, at_ticks) + uint64_t(p.realtime_offset_ns));
+    }
+
+    /// Measured tick rate
+    double ticks_per_second()
+    {
+        return double(uint64_t(1) << 32) * 1e9 / double(load().ns_per_tick_q32);
+    }
+
+    /// Take a fresh calibration point now, unless another thread already is
+    void try_recalibrate()
+    {
+        std::unique_lock<std::mutex> guard(writer, std::try_to_lock);
+        if (guard.owns_lock())
+            publish(anchor, take_sample());
+    }
+
+private:
+    struct params
+    {
+        uint64_t base_ticks;
+        uint64_t base_mono_ns;
+        uint64_t ns_per_tick_q32;
+        uint64_t recalibrate_ticks;
+        int64_t realtime_offset_ns;
+    };
+
+    // Readers retry while sequence is odd or changed: a seqlock
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint64_t> base_ticks{0};
+    std::atomic<uint64_t> base_mono_ns{0};
+    std::atomic<uint64_t> ns_per_tick_q32{uint64_t(1) << 32};
+    std::atomic<uint64_t> recalibrate_ticks{0};
+    std::atomic<int64_t> realtime_offset_ns{0};
+    std::mutex writer;
+    sample anchor;
+
+    static uint64_t monotonic_ns()
+    {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * timestamp::SEC_NS + ts.tv_nsec;
+    }
+
+    /// The clock_gettime() with the tightest tick bracket of a few tries
+    static sample take_sample()
+    {
+        sample best{0, 0};
+        uint64_t best_width = UINT64_MAX;
+        for (int i = 0; i < 8; ++i) {
+            const uint64_t before = ticks_ordered();
+            const uint64_t mono = monotonic_ns();
+            const uint64_t after = ticks_ordered();
+            if (after - before < best_width) {
+                best_width = after - before;
+                best = sample{before + (after - before) / 2, mono};
+            }
+        }
+        return best;
+    }
+
+    /// The calibration for at_ticks, refreshed first when it is stale
+    params current(uint64_t at_ticks)
+    {
+        params p = load();
+        if (int64_t(at_ticks - p.base_ticks) > int64_t(p.recalibrate_ticks)) {
+            try_recalibrate();
+            p = load();
+        }
+        return p;
+    }
+    /// CLOCK_MONOTONIC nanoseconds at ticks under calibration p
+    static uint64_t convert(const params& p, uint64_t at_ticks)
+    {
+        return p.base_mono_ns + impl::mul_q32(int64_t(at_ticks - p.base_ticks), p.ns_per_tick_q32);
+    }
+
+    params load() const
+    {
+        params p;
+        uint32_t seq;
+        do {
+            seq = sequence.load(std::memory_order_acquire);
+            p.base_ticks = base_ticks.load(std::memory_order_relaxed);
+            p.base_mono_ns = base_mono_ns.load(std::memory_order_relaxed);
+            p.ns_per_tick_q32 = ns_per_tick_q32.load(std::memory_order_relaxed);
+            p.recalibrate_ticks = recalibrate_ticks.load(std::memory_order_relaxed);
+            p.realtime_offset_ns = realtime_offset_ns.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || sequence.load(std::memory_order_relaxed) != seq);
+        return p;
+    }
+
+    /// The rate comes from the longest baseline, the offset from the latest point
+    void publish(const sample& from, const sample& to)
+    {
+        const uint64_t tick_span = std::max<uint64_t>(to.ticks - from.ticks, 1);
+        const uint64_t rate = impl::div_q32(to.mono_ns - from.mono_ns, tick_span);
+        const uint64_t interval_ns = std::max<int64_t>(recalibrate_after.count(), 1);
+        const uint64_t interval_ticks = impl::div_q32(interval_ns, std::max<uint64_t>(rate, 1));
+
+        struct timespec real, mono;
+        ::clock_gettime(CLOCK_REALTIME, &real);
+        ::clock_gettime(CLOCK_MONOTONIC, &mono);
+        const int64_t offset = (int64_t(real.tv_sec) - mono.tv_sec) * timestamp::SEC_NS + (real.tv_nsec - mono.tv_nsec);
+
+        const uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        base_ticks.store(to.ticks, std::memory_order_relaxed);
+        base_mono_ns.store(to.mono_ns, std::memory_order_relaxed);
+        ns_per_tick_q32.store(rate, std::memory_order_relaxed);
+        recalibrate_ticks.store(std::min<uint64_t>(interval_ticks, INT64_MAX), std::memory_order_relaxed);
+        realtime_offset_ns.store(offset, std::memory_order_relaxed);
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+};
+
+inline timestamp tsc_stamp::to_timestamp() const
+{
+    return tsc_clock::global().to_timestamp(ticks);
+}
+inline timestamp tsc_stamp::to_monotonic() const
+{
+    return tsc_clock::global().to_monotonic(ticks);
+}
+
+} // namespace common
+
+#endif // COMMON_TSC_CLOCK_HPP
@@ -0,0 +1,47 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "common/checksum.hpp"
+
+namespace
+{
+
+// The original byte-at-a-time table lookup, for comparison.
+uint32_t crc32c_bytewise(const std::string& bytes)
+{
+    const auto& table = common::impl::crc32c_table().table[0];
+    uint32_t crc = ~0u;
+    for (char c : bytes)
+        crc = table[(crc ^ uint8_t(c)) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+template <typename Fn>
+void bench(const char* name, size_t bytes, Fn&& fn)
+{
+    uint64_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const int rounds = 5;
+    for (int i = 0; i < rounds; ++i)
+        sink += fn();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-28s %8.1f MB/s (%016llx)\n", name, bytes * rounds / elapsed.count() / 1e6, (unsigned long long)sink);
+}
+
+} // namespace
+
+int main()
+{
+    std::string data(64 * 1024 * 1024, '\0');
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = char(i * 2654435761u >> 13);
+    const common::array_view<const char> bytes{data.data(), data.size()};
+
+    bench("crc32c bytewise", data.size(), [&] { return crc32c_bytewise(data); });
+    bench("crc32c slicing-by-8", data.size(), [&] {
+        return ~common::impl::crc32c_sliced(~0u, data.data(), data.size());
+    });
+    bench("crc32c", data.size(), [&] { return common::crc32c(bytes); });
+    bench("xxhash64", data.size(), [&] { return common::xxhash64(bytes); });
+    return 0;
+}
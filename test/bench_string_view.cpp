@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "common/string_view.hpp"
+
+using common::string_view;
+
+namespace
+{
+
+// The original per-byte memchr() over the pattern, for comparison.
+const char* find_any_memchr(string_view source, string_view chars)
+{
+    auto it = std::find_if(source.begin(), source.end(), [&chars] (char chr) {
+        return ::memchr(chars.data(), chr, chars.size()) != nullptr;
+    });
+    return (it != source.end()) ? it : nullptr;
+}
+
+// The original memmem() per find, for comparison.
+const char* find_str_memmem(string_view source, string_view needle)
+{
+    return static_cast<const char*>(::memmem(source.data(), source.size(), needle.data(), needle.size()));
+}
+
+template <typename Fn>
+void bench(const char* name, size_t bytes, Fn&& fn)
+{
+    size_t tokens = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const int rounds = 5;
+    for (int i = 0; i < rounds; ++i)
+        tokens += fn();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-28s %8.1f MB/s (%zu tokens)\n", name, bytes * rounds / elapsed.count() / 1e6, tokens / rounds);
+}
+
+std::string make_log(size_t bytes)
+{
+    std::string out;
+    out.reserve(bytes + 64);
+    unsigned seed = 1;
+    while (out.size() < bytes) {
+        seed = seed * 1103515245 + 12345;
+        out.append((seed >> 16) % 24 + 1, 'a' + (seed >> 8) % 26);
+        static const char* const separators[] = {" ", "\t", "\r\n", ","};
+        out += separators[(seed >> 4) % 4];
+    }
+    return out;
+}
+
+} // namespace
+
+int main()
+{
+    const std::string log = make_log(200 * 1024 * 1024);
+    const string_view source{log};
+    const string_view chars{" \t\r\n,"};
+
+    bench("any_char memchr-per-byte", log.size(), [&] {
+        size_t count = 0;
+        string_view remaining = source;
+        while (const char* pos = find_any_memchr(remaining, chars)) {
+            count += (pos != remaining.begin());
+            remaining = string_view{pos + 1, remaining.end()};
+        }
+        return count;
+    });
+    bench("splitter::any_char", log.size(), [&] {
+        return source.split_fn(string_view::splitter::any_char(chars), [] (string_view) {});
+    });
+
+    const string_view separator{"\r\n"};
+    bench("string memmem", log.size(), [&] {
+        size_t count = 0;
+        string_view remaining = source;
+        while (const char* pos = find_str_memmem(remaining, separator)) {
+            count += 1;
+            remaining = string_view{pos + separator.size(), remaining.end()};
+        }
+        return count;
+    });
+    bench("splitter::string", log.size(), [&] {
+        return source.split_fn(string_view::splitter::string(separator), [] (string_view) {});
+    });
+
+    bench("split_fn lines", log.size(), [&] {
+        return source.split_fn('\n', [] (string_view) {});
+    });
+    std::vector<uint32_t> offsets(4096);
+    bench("split_fn_indexed lines", log.size(), [&] {
+        return source.split_fn_indexed('\n', common::make_array_view(offsets), [] (string_view) {});
+    });
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <chrono>
+#include <cstdio>
+#include "common/common_timestamp.hpp"
+#include "common/common_timestamp_fmt.hpp"
+#include "common/tsc_clock.hpp"
+
+namespace
+{
+
+template <typename Fn>
+void bench(const char* name, Fn&& fn)
+{
+    const int calls = 20 * 1000 * 1000;
+    uint64_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i)
+        sink += fn();
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-28s %6.2f ns/call (%llu)\n", name, elapsed.count() / calls, (unsigned long long)(sink & 0xff));
+}
+
+} // namespace
+
+int main()
+{
+    common::tsc_clock::global();
+    bench("timestamp::now", [] { return common::timestamp::now().nsecs; });
+    bench("timestamp::monotonic_now", [] { return common::timestamp::monotonic_now().nsecs; });
+    bench("timestamp::coarse_now", [] { return common::timestamp::coarse_now().nsecs; });
+    bench("timestamp::monotonic_coarse", [] { return common::timestamp::monotonic_coarse_now().nsecs; });
+    bench("tsc_clock::now", [] { return common::tsc_clock::now().ticks; });
+    bench("tsc_clock::now + convert", [] { return common::tsc_clock::now().to_timestamp().nsecs; });
+
+    // Log-line-like stamps, ~1000 per second
+    std::array<char, 64> buf;
+    common::timestamp stamp{1700000000, 0};
+    bench("timestamp_fmt strftime", [&] {
+        stamp += common::duration::microseconds(997);
+        return common::timestamp_fmt(common::make_array_view(buf), "%Y-%m-%dT%H:%M:%SZ", stamp);
+    });
+    bench("timestamp_fmt_iso8601", [&] {
+        stamp += common::duration::microseconds(997);
+        return common::timestamp_fmt_iso8601(common::make_array_view(buf), stamp);
+    });
+    bench("timestamp_fmt_iso8601 new sec", [&] {
+        stamp += common::duration::seconds(1);
+        return common::timestamp_fmt_iso8601(common::make_array_view(buf), stamp);
+    });
+
+    const char* const text = "2023-11-14T22:13:20.123456789Z";
+    bench("strptime + timegm", [&] {
+        struct tm tm = {};
+        ::strptime(text, "%Y-%m-%dT%H:%M:%S", &tm);
+        return uint64_t(::timegm(&tm));
+    });
+    bench("parse_timestamp", [&] {
+        return common::parse_timestamp(text).res().secs;
+    });
+    return 0;
+}
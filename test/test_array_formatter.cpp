@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include "common/array_formatter.hpp"
+#include "common/buffer_formatter.hpp"
+
+using common::string_view;
+
+TEST(array_formatter, format) {
+    common::array_formatter<32> fmt{"%s=%d", "key", 5};
+    EXPECT_EQ(fmt.str(), "key=5");
+    fmt.format(", %s", "more");
+    EXPECT_EQ(fmt.str(), "key=5, more");
+    EXPECT_STREQ(fmt.c_str(), "key=5, more");
+}
+
+TEST(array_formatter, append_integers) {
+    common::array_formatter<128> fmt;
+    fmt.append(0).append(' ').append(-1).append(' ').append(1234567890123ll);
+    fmt.append(' ').append(std::numeric_limits<int64_t>::min());
+    fmt.append(' ').append(std::numeric_limits<uint64_t>::max());
+    fmt.append(' ').append(uint8_t(255));
+    EXPECT_EQ(fmt.str(), "0 -1 1234567890123 -9223372036854775808 18446744073709551615 255");
+    EXPECT_STREQ(fmt.c_str(), fmt.to_string().c_str());
+}
+
+TEST(array_formatter, append_hex) {
+    common::array_formatter<64> fmt;
+    fmt.append("0x").append_hex(0xdeadbeef).append(" ").append_hex(0x2a, 4).append(" ").append_hex(0);
+    EXPECT_EQ(fmt.str(), "0xdeadbeef 002a 0");
+}
+
+TEST(array_formatter, append_double) {
+    common::array_formatter<128> fmt;
+    fmt.append(0.1).append(' ').append(1.5).append(' ').append(-2.0 / 3.0, 3).append(' ').append(100.0, 2);
+    EXPECT_EQ(fmt.str(), "0.1 1.5 -0.667 100.00");
+}
+
+TEST(array_formatter, append_double_like_printf) {
+    // Fixed-point stays fixed however large, and both conversions agree with printf
+    const double values[] = {1e300, -1.7976931348623157e308, 0.125, 2.5, 5e-324, -0.0, 1.0 / 3.0};
+    for (double value : values) {
+        for (int precision : {0, 2, 6, 40}) {
+            char expected[512];
+            ::snprintf(expected, sizeof(expected), "%.*f", precision, value);
+            common::array_formatter<512> fmt;
+            fmt.append(value, precision);
+            EXPECT_EQ(fmt.str().to_string(), expected);
+            EXPECT_EQ(common::impl::format_double(value, precision).str().to_string(), expected);
+        }
+    }
+    // Shortest text, the same with or without std::to_chars()
+    const std::pair<double, const char*> shortest[] = {
+        {0.1, "0.1"}, {1e21, "1e+21"}, {123456.0, "123456"}, {1e-7, "1e-07"},
+        {5e-324, "5e-324"}, {1.7976931348623157e308, "1.7976931348623157e+308"}, {-0.0, "-0"},
+    };
+    for (const auto& item : shortest) {
+        EXPECT_EQ(common::double_chars(item.first).str(), string_view{item.second});
+        EXPECT_EQ(common::impl::format_double(item.first, -1).str(), string_view{item.second});
+    }
+}
+
+TEST(array_formatter, append_mixed_with_format) {
+    common::array_formatter<64> fmt;
+    fmt.append("took ").append(42).format("%s", "ns");
+    EXPECT_EQ(fmt.str(), "took 42ns");
+}
+
+TEST(array_formatter, append_truncates) {
+    common::array_formatter<8> fmt;
+    fmt.append("1234").append(567890);
+    EXPECT_EQ(fmt.str(), "1234567");
+    EXPECT_STREQ(fmt.c_str(), "1234567");
+    fmt.append("more");
+    EXPECT_EQ(fmt.str(), "1234567");
+}
+
+TEST(static_format, array_formatter) {
+    common::array_formatter<128> fmt;
+    const std::string name = "probe";
+    fmt.format(COMMON_FMT("id=%d name=%s took %.3fs flags=%08x %c%%"), 42, name, 1.23456, 0xbeefu, 'z');
+    EXPECT_EQ(fmt.str(), "id=42 name=probe took 1.235s flags=0000beef z%");
+    EXPECT_STREQ(fmt.c_str(), "id=42 name=probe took 1.235s flags=0000beef z%");
+}
+
+TEST(static_format, matches_printf) {
+    common::array_formatter<128> checked;
+    checked.format(COMMON_FMT("%lu items, %lld bytes, %zu left, %f%% done"), 7ul, -12ll, size_t(3), 99.5);
+    common::array_formatter<128> printf_style{"%lu items, %lld bytes, %zu left, %f%% done", 7ul, -12ll, size_t(3), 99.5};
+    EXPECT_EQ(checked.str(), printf_style.str());
+}
+
+TEST(static_format, unsigned_and_null) {
+    common::array_formatter<128> checked;
+    const char* null_str = nullptr;
+    checked.format(COMMON_FMT("%u %x %u %lu %s"), -1, -1, short(-2), 5ul, null_str);
+    common::array_formatter<128> printf_style{"%u %x %u %lu %s", -1, -1, short(-2), 5ul, "(null)"};
+    EXPECT_EQ(checked.str(), printf_style.str());
+    EXPECT_EQ(checked.str(), "4294967295 ffffffff 4294967294 5 (null)");
+}
+
+TEST(static_format, view_advance) {
+    std::array<char, 16> buf;
+    common::string_view_writeable view{buf};
+    common::string_view_writeable rest = common::static_format_advance(view, COMMON_FMT("a=%u b=%s"), 10u, "twelve chars");
+    EXPECT_EQ(rest.size(), 0u);
+    EXPECT_EQ(common::string_view(buf.data(), buf.size()), "a=10 b=twelve ch");
+}
+
+TEST(static_format, constexpr_parse) {
+    using common::impl::parse_format;
+    constexpr auto table = parse_format<5>("x%dy%%z%s");
+    static_assert(table.count == 4, "segments");
+    static_assert(table.arg_count == 2, "arguments");
+    static_assert(table.arg_index[2] == 1, "argument of %s");
+    static_assert(common::impl::format_segment_bound("x%dy%%z%s") == 5, "bound");
+    static_assert(!parse_format<2>("%q").valid, "unsupported conversion");
+    static_assert(!parse_format<2>("%5d").valid, "unsupported width");
+    static_assert(!parse_format<2>("trailing %").valid, "dangling percent");
+}
+
+TEST(buffer_formatter, inline) {
+    common::buffer_formatter<32> fmt{"%s=%d", "key", 5};
+    fmt.append(", ").append(1.5);
+    EXPECT_EQ(fmt.str(), "key=5, 1.5");
+    EXPECT_STREQ(fmt.c_str(), "key=5, 1.5");
+    EXPECT_EQ(fmt.capacity(), 32u);
+}
+
+TEST(buffer_formatter, grows) {
+    common::buffer_formatter<16> fmt;
+    fmt.format("%s", "0123456789");
+    fmt.format("%s-%d", "abcdefghijklmnopqrstuvwxyz", 42);
+    EXPECT_EQ(fmt.str(), "0123456789abcdefghijklmnopqrstuvwxyz-42");
+    EXPECT_STREQ(fmt.c_str(), "0123456789abcdefghijklmnopqrstuvwxyz-42");
+    EXPECT_GE(fmt.capacity(), fmt.size() + 1);
+
+    const std::string long_text(1000, 'x');
+    fmt.append(long_text);
+    EXPECT_EQ(fmt.size(), 1039u);
+    EXPECT_TRUE(fmt.str().ends_with(long_text));
+}
+
+TEST(buffer_formatter, keeps_capacity) {
+    common::buffer_formatter<8> fmt;
+    fmt.format(COMMON_FMT("%s %d"), "a much longer message than fits inline", 1);
+    const size_t capacity = fmt.capacity();
+    const char* data = fmt.c_str();
+    EXPECT_GT(capacity, 8u);
+    fmt.clear();
+    EXPECT_EQ(fmt.str(), "");
+    EXPECT_STREQ(fmt.c_str(), "");
+    fmt.format("%s", "short again");
+    EXPECT_EQ(fmt.capacity(), capacity);
+    EXPECT_EQ(fmt.c_str(), data);
+    EXPECT_EQ(fmt.str(), "short again");
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include "common/async_reader.hpp"
+#include "common/file_handle.hpp"
+#include "test_temp_file.hpp"
+
+using common::async_reader;
+using common::string_view;
+
+struct async_reader_test : ::testing::TestWithParam<async_reader::engine>
+{
+    std::string name;
+    std::string content;
+    int fd = -1;
+
+    void SetUp() override
+    {
+        for (int i = 0; i < 4096; ++i)
+            content += char('a' + i % 26);
+        name = make_temp_file(string_view{content});
+        fd = ::open(name.c_str(), O_RDONLY);
+        ASSERT_GE(fd, 0);
+    }
+    void TearDown() override
+    {
+        ::close(fd);
+        ::unlink(name.c_str());
+    }
+};
+
+TEST_P(async_reader_test, batch) {
+    async_reader reader;
+    ASSERT_TRUE(reader.init(4, GetParam()).is_ok());
+
+    std::vector<std::array<char, 100>> buffers(20);
+    std::vector<common::read_request> requests;
+    for (size_t i = 0; i < buffers.size(); ++i)
+        requests.push_back({fd, i * 200, common::make_array_view(buffers[i])});
+    // Short read at the end of the file, and a failing read
+    std::array<char, 100> tail_buffer, bad_buffer;
+    requests.push_back({fd, content.size() - 10, common::make_array_view(tail_buffer)});
+    requests.push_back({-1, 0, common::make_array_view(bad_buffer)});
+
+    std::vector<bool> seen(requests.size());
+    auto res = reader.read_batch(common::make_array_view(requests).to_const(), [&] (size_t index, common::result<common::array_view<char>, common::unix_err> read) {
+        seen[index] = true;
+        if (index == requests.size() - 1) {
+            ASSERT_TRUE(read.is_err());
+            EXPECT_EQ(read.err(), EBADF);
+            return;
+        }
+        ASSERT_TRUE(read.is_ok());
+        const common::read_request& req = requests[index];
+        EXPECT_EQ(string_view{read.res()}, string_view{content}.advance(req.offset).head(req.into.size()));
+    });
+    ASSERT_TRUE(res.is_ok());
+    EXPECT_EQ(std::count(seen.begin(), seen.end(), true), ssize_t(requests.size()));
+}
+
+TEST_P(async_reader_test, reused_after_eof) {
+    async_reader reader;
+    ASSERT_TRUE(reader.init(1, GetParam()).is_ok());
+
+    // Reads past the end keep going until end of file, and leave nothing behind for the next batch
+    std::vector<char> buffer(3 * content.size());
+    for (int round = 0; round < 3; ++round) {
+        common::read_request requests[] = {
+            {fd, 0, common::make_array_view(buffer)},
+            {fd, content.size(), common::make_array_view(buffer)},
+        };
+        size_t calls = 0;
+        auto res = reader.read_batch(common::make_array_view(requests).to_const(), [&] (size_t index, common::result<common::array_view<char>, common::unix_err> read) {
+            calls += 1;
+            ASSERT_TRUE(read.is_ok());
+            EXPECT_EQ(read.res().size(), index == 0 ? content.size() : 0u);
+        });
+        ASSERT_TRUE(res.is_ok());
+        EXPECT_EQ(calls, 2u);
+    }
+}
+
+TEST_P(async_reader_test, callback_throws) {
+    if (GetParam() != async_reader::engine::threads)
+        GTEST_SKIP();
+    async_reader reader;
+    ASSERT_TRUE(reader.init(4, GetParam()).is_ok());
+
+    std::vector<std::array<char, 100>> buffers(40);
+    std::vector<common::read_request> requests;
+    for (size_t i = 0; i < buffers.size(); ++i)
+        requests.push_back({fd, i * 100, common::make_array_view(buffers[i])});
+    // Workers outlive the batch, but none may be reading once it throws
+    for (int round = 0; round < 3; ++round) {
+        EXPECT_THROW(reader.read_batch(common::make_array_view(requests).to_const(), [] (size_t, common::result<common::array_view<char>, common::unix_err>) {
+            throw std::runtime_error("stop");
+        }), std::runtime_error);
+        std::lock_guard<std::mutex> guard(reader.pool->lock);
+        EXPECT_TRUE(reader.pool->jobs.empty());
+        EXPECT_EQ(reader.pool->running, 0u);
+        EXPECT_EQ(reader.pool->threads.size(), 4u);
+    }
+    size_t calls = 0;
+    auto res = reader.read_batch(common::make_array_view(requests).to_const(), [&] (size_t, common::result<common::array_view<char>, common::unix_err> read) {
+        EXPECT_TRUE(read.is_ok());
+        calls += 1;
+    });
+    ASSERT_TRUE(res.is_ok());
+    EXPECT_EQ(calls, requests.size());
+}
+
+INSTANTIATE_TEST_SUITE_P(engines, async_reader_test, ::testing::Values(async_reader::engine::automatic, async_reader::engine::threads));
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include "common/atomic_file_writer.hpp"
+#include "common/string_view.hpp"
+#include "test_temp_file.hpp"
+
+using common::string_view;
+using common::atomic_file_writer;
+
+struct atomic_file_writer_test : ::testing::Test
+{
+    std::string dir;
+    std::string target;
+
+    void SetUp() override
+    {
+        dir = make_temp_dir();
+        target = dir + "/state";
+    }
+    void TearDown() override
+    {
+        for (const std::string& name : entries())
+            ::unlink((dir + "/" + name).c_str());
+        ::rmdir(dir.c_str());
+    }
+    std::vector<std::string> entries() const
+    {
+        std::vector<std::string> names;
+        DIR* d = ::opendir(dir.c_str());
+        while (struct dirent* entry = d ? ::readdir(d) : nullptr) {
+            if (entry->d_name[0] != '.')
+                names.push_back(entry->d_name);
+        }
+        if (d)
+            ::closedir(d);
+        return names;
+    }
+    std::string content() const
+    {
+        common::fd_handle file{target.c_str()};
+        std::string out(file.size(), '\0');
+        file.read_at(common::make_array_view(&out[0], out.size()), 0);
+        return out;
+    }
+};
+
+TEST_F(atomic_file_writer_test, replace) {
+    ASSERT_TRUE(common::write_file_atomic(target.c_str(), string_view{"old content"}).is_ok());
+    EXPECT_EQ(content(), "old content");
+
+    atomic_file_writer writer;
+    ASSERT_TRUE(writer.open(target.c_str(), 3).is_ok());
+    ASSERT_TRUE(writer.write(string_view{"new"}).is_ok());
+    EXPECT_EQ(content(), "old content");
+    ASSERT_TRUE(writer.commit(atomic_file_writer::durability::atomic_only).is_ok());
+    EXPECT_EQ(content(), "new");
+    EXPECT_EQ(entries(), std::vector<std::string>{"state"});
+}
+
+TEST_F(atomic_file_writer_test, abandoned) {
+    ASSERT_TRUE(common::write_file_atomic(target.c_str(), string_view{"kept"}).is_ok());
+    {
+        atomic_file_writer writer;
+        ASSERT_TRUE(writer.open(target.c_str()).is_ok());
+        ASSERT_TRUE(writer.write(string_view{"discarded"}).is_ok());
+    }
+    EXPECT_EQ(content(), "kept");
+    EXPECT_EQ(entries(), std::vector<std::string>{"state"});
+}
+
+TEST_F(atomic_file_writer_test, mode_ignores_umask) {
+    const mode_t old_mask = ::umask(077);
+    atomic_file_writer writer;
+    auto res = writer.open(target.c_str(), 0, 0644);
+    ::umask(old_mask);
+    ASSERT_TRUE(res.is_ok());
+    ASSERT_TRUE(writer.commit(atomic_file_writer::durability::atomic_only).is_ok());
+    struct stat st;
+    ASSERT_EQ(::stat(target.c_str(), &st), 0);
+    EXPECT_EQ(st.st_mode & 0777, 0644u);
+}
+
+TEST_F(atomic_file_writer_test, large_writes) {
+    // Straddle chunk boundaries with a mix of small and multi-chunk writes
+    std::string expected;
+    atomic_file_writer writer;
+    ASSERT_TRUE(writer.open(target.c_str(), 5 * atomic_file_writer::CHUNK_SIZE).is_ok());
+    for (size_t size : {size_t(10), size_t(3 * atomic_file_writer::CHUNK_SIZE + 7), size_t(atomic_file_writer::CHUNK_SIZE), size_t(1)}) {
+        std::string part(size, char('a' + expected.size() % 26));
+        expected += part;
+        ASSERT_TRUE(writer.write(string_view{part}).is_ok());
+    }
+    ASSERT_TRUE(writer.commit().is_ok());
+    EXPECT_EQ(content(), expected);
+}
+
+TEST_F(atomic_file_writer_test, stage_errors) {
+    atomic_file_writer writer;
+    const std::string missing = dir + "/missing/state";
+    auto res = writer.open(missing.c_str());
+    ASSERT_FALSE(res.is_ok());
+    EXPECT_EQ(res.err().unix_errno, ENOENT);
+    EXPECT_EQ(writer.failed_stage, atomic_file_writer::stage::create);
+
+    // The target became a directory: the data is written and synced, but rename() fails
+    ASSERT_TRUE(writer.open(target.c_str()).is_ok());
+    ASSERT_TRUE(writer.write(string_view{"data"}).is_ok());
+    ASSERT_EQ(::mkdir(target.c_str(), 0755), 0);
+    ASSERT_FALSE(writer.commit().is_ok());
+    EXPECT_EQ(writer.failed_stage, atomic_file_writer::stage::rename);
+    writer.abort();
+    EXPECT_EQ(entries(), std::vector<std::string>{"state"});
+    ::rmdir(target.c_str());
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "common/checksum.hpp"
+#include "common/string_view.hpp"
+
+using common::string_view;
+
+static uint32_t crc32c_bitwise(string_view bytes)
+{
+    uint32_t crc = ~0u;
+    for (char c : bytes) {
+        crc ^= uint8_t(c);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static std::string random_bytes(size_t size)
+{
+    std::mt19937 rng{1234};
+    std::string bytes(size, '\0');
+    for (char& c : bytes)
+        c = char(rng());
+    return bytes;
+}
+
+TEST(checksum, crc32c_vectors) {
+    EXPECT_EQ(common::crc32c(string_view{""}), 0u);
+    EXPECT_EQ(common::crc32c(string_view{"a"}), 0xC1D04330u);
+    EXPECT_EQ(common::crc32c(string_view{"123456789"}), 0xE3069283u);
+    EXPECT_EQ(common::crc32c(string_view{"56789"}, common::crc32c(string_view{"1234"})), 0xE3069283u);
+    const std::string zeros(32, '\0');
+    EXPECT_EQ(common::crc32c(string_view{zeros}), 0x8A9136AAu);
+}
+
+TEST(checksum, crc32c_lengths) {
+    // Cover the unaligned head, both interleaved lane sizes and the tails
+    const std::string data = random_bytes(3 * 8192 * 2 + 3 * 256 + 77);
+    for (size_t offset : {0, 1, 5}) {
+        for (size_t size : {0, 1, 7, 8, 9, 255, 768, 769, 3 * 8192 - 1, 3 * 8192 + 3 * 256 + 13, 3 * 8192 * 2}) {
+            const string_view part = string_view{data}.advance(offset).head(size);
+            EXPECT_EQ(common::crc32c(part), crc32c_bitwise(part)) << offset << "+" << size;
+            EXPECT_EQ(~common::impl::crc32c_sliced(~0u, part.data(), part.size()), crc32c_bitwise(part));
+        }
+    }
+}
+
+TEST(checksum, crc32c_streaming) {
+    const std::string data = random_bytes(100000);
+    common::crc32c_state state;
+    size_t done = 0;
+    for (size_t step = 1; done < data.size(); step = step * 3 + 1) {
+        const string_view part = string_view{data}.advance(done).head(step);
+        state.update(part);
+        done += part.size();
+    }
+    EXPECT_EQ(state.digest(), common::crc32c(string_view{data}));
+}
+
+TEST(checksum, xxhash64_vectors) {
+    EXPECT_EQ(common::xxhash64(string_view{""}), 0xEF46DB3751D8E999ull);
+    EXPECT_EQ(common::xxhash64(string_view{"a"}), 0xD24EC4F1A98C6E5Bull);
+    EXPECT_EQ(common::xxhash64(string_view{"abc"}), 0x44BC2CF5AD770999ull);
+    EXPECT_NE(common::xxhash64(string_view{"abc"}, 1), common::xxhash64(string_view{"abc"}));
+}
+
+TEST(checksum, xxhash64_streaming) {
+    const std::string data = random_bytes(1000);
+    for (size_t split : {0, 1, 31, 32, 33, 100, 999}) {
+        for (size_t size : {0, 5, 31, 32, 64, 1000}) {
+            if (split > size)
+                continue;
+            const string_view whole = string_view{data}.head(size);
+            common::xxhash64_state state{7};
+            state.update(whole.head(split));
+            state.update(whole.advance(split));
+            EXPECT_EQ(state.digest(), common::xxhash64(whole, 7)) << split << "/" << size;
+        }
+    }
+}
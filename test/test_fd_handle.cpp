@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "common/fd_handle.hpp"
+#include "common/string_view.hpp"
+#include "test_temp_file.hpp"
+
+using common::string_view;
+
+struct fd_handle_test : ::testing::Test
+{
+    std::string name;
+    common::fd_handle file;
+
+    void SetUp() override
+    {
+        name = make_temp_file();
+        ASSERT_TRUE(file.open(name.c_str(), O_RDWR).is_ok());
+    }
+    void TearDown() override
+    {
+        ::unlink(name.c_str());
+    }
+};
+
+TEST_F(fd_handle_test, positional) {
+    ASSERT_TRUE(file.write_at(string_view{"world"}, 6).is_ok());
+    ASSERT_TRUE(file.write_at(string_view{"hello "}, 0).is_ok());
+    EXPECT_EQ(file.size(), 11u);
+
+    std::array<char, 32> buf;
+    auto read = file.read_at(common::make_array_view(buf), 3);
+    ASSERT_TRUE(read.is_ok());
+    EXPECT_EQ(string_view{read.res()}, "lo world");
+}
+
+TEST_F(fd_handle_test, sequential) {
+    ASSERT_TRUE(file.write(string_view{"abc"}).is_ok());
+    ASSERT_TRUE(file.write(string_view{"def"}).is_ok());
+    common::fd_handle reader{name.c_str()};
+    std::array<char, 4> buf;
+    EXPECT_EQ(string_view{reader.read_view(common::make_array_view(buf)).res()}, "abcd");
+    EXPECT_EQ(string_view{reader.read_view(common::make_array_view(buf)).res()}, "ef");
+    EXPECT_EQ(string_view{reader.read_view(common::make_array_view(buf)).res()}, "");
+}
+
+TEST_F(fd_handle_test, concurrent_reads) {
+    std::string content;
+    for (int i = 0; i < 64 * 1024; ++i)
+        content += char('a' + i % 26);
+    ASSERT_TRUE(file.write_at(string_view{content}, 0).is_ok());
+
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches{0};
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            std::array<char, 4096> page;
+            for (size_t i = 0; i < 64; ++i) {
+                const uint64_t offset = ((i * 7 + t) % 16) * page.size();
+                auto read = file.read_at(common::make_array_view(page), offset);
+                if (!read || string_view{read.res()} != string_view{content}.advance(offset).head(page.size()))
+                    mismatches += 1;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(mismatches, 0);
+}
+
+TEST(fd_handle, missing) {
+    common::fd_handle file;
+    auto res = file.open("/nonexistent/common_cxx/file");
+    ASSERT_TRUE(res.is_err());
+    EXPECT_EQ(res.err(), ENOENT);
+    std::array<char, 4> buf;
+    EXPECT_EQ(file.read_at(common::make_array_view(buf), 0).err(), ENOENT);
+}
+
+TEST_F(fd_handle_test, write_all) {
+    std::vector<std::string> pieces;
+    std::vector<common::array_view<const char>> parts;
+    std::string expected;
+    for (int i = 0; i < 200; ++i)
+        pieces.push_back(std::string(i % 5, char('a' + i % 26)));
+    for (const std::string& piece : pieces) {
+        parts.push_back(string_view{piece});
+        expected += piece;
+    }
+    ASSERT_TRUE(file.write(string_view{"head:"}).is_ok());
+    ASSERT_TRUE(file.write_all(common::make_array_view(parts).to_const()).is_ok());
+    EXPECT_EQ(file.size(), expected.size() + 5);
+
+    ASSERT_TRUE(file.write_all_at(common::make_array_view(parts).to_const(), 1000).is_ok());
+    std::vector<char> buf(expected.size());
+    auto read = file.read_at(common::make_array_view(buf), 1000);
+    ASSERT_TRUE(read.is_ok());
+    EXPECT_EQ(string_view{read.res()}, string_view{expected});
+    read = file.read_at(common::make_array_view(buf), 5);
+    EXPECT_EQ(string_view{read.res()}, string_view{expected});
+}
+
+TEST(write_vectored, no_progress) {
+    std::array<common::array_view<const char>, 2> parts{{string_view{"ab"}, string_view{"cd"}}};
+    int calls = 0;
+    auto res = common::impl::write_vectored(common::make_array_view(parts).to_const(), [&] (const struct iovec*, int, uint64_t written) -> ssize_t {
+        calls += 1;
+        return written ? 0 : 1;
+    });
+    ASSERT_TRUE(res.is_err());
+    EXPECT_EQ(res.err(), EIO);
+    EXPECT_EQ(calls, 2);
+}
+
+TEST_F(fd_handle_test, advise) {
+    ASSERT_TRUE(file.write_at(string_view{"some cached data"}, 0).is_ok());
+    EXPECT_TRUE(file.advise_sequential().is_ok());
+    EXPECT_TRUE(file.prefetch_async().is_ok());
+    EXPECT_TRUE(file.readahead(0, 16).is_ok());
+    EXPECT_TRUE(file.readahead(0, 0).is_ok());
+    EXPECT_TRUE(file.readahead(1 << 20, 0).is_ok());
+    EXPECT_TRUE(file.advise_dontneed(0, 16).is_ok());
+    EXPECT_TRUE(file.advise_random().is_ok());
+
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    common::fd_handle read_end{fds[0]}, write_end{fds[1]};
+    EXPECT_EQ(read_end.advise_sequential().err().unix_errno, ESPIPE);
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "common/file_copy.hpp"
+#include "common/string_view.hpp"
+#include "test_temp_file.hpp"
+
+using common::string_view;
+
+struct file_copy_test : ::testing::Test
+{
+    std::vector<std::string> names;
+    std::string data;
+
+    void SetUp() override
+    {
+        data.resize(3 * 1024 * 1024 + 123);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = char(i * 2654435761u >> 11);
+    }
+    void TearDown() override
+    {
+        for (const std::string& name : names)
+            ::unlink(name.c_str());
+    }
+    std::string temp_file(string_view content)
+    {
+        names.push_back(make_temp_file(content));
+        return names.back();
+    }
+    static std::string read_file(const std::string& name)
+    {
+        common::fd_handle file{name.c_str()};
+        std::string out(file.size(), '\0');
+        file.read_at(common::make_array_view(&out[0], out.size()), 0);
+        return out;
+    }
+};
+
+TEST_F(file_copy_test, copy_file) {
+    const std::string src = temp_file(string_view{data});
+    ASSERT_EQ(::chmod(src.c_str(), 0640), 0);
+    const std::string dst = src + ".copy";
+    names.push_back(dst);
+
+    auto res = common::copy_file(src.c_str(), dst.c_str());
+    ASSERT_TRUE(res.is_ok());
+    EXPECT_EQ(res.res(), data.size());
+    EXPECT_EQ(read_file(dst), data);
+    struct stat stat_buf;
+    ASSERT_EQ(::stat(dst.c_str(), &stat_buf), 0);
+    EXPECT_EQ(stat_buf.st_mode & 07777, 0640u);
+
+    // Overwrites a longer destination
+    const std::string shorter = temp_file(string_view{"short"});
+    EXPECT_EQ(common::copy_file(shorter.c_str(), dst.c_str()).res(), 5u);
+    EXPECT_EQ(read_file(dst), "short");
+
+    EXPECT_EQ(common::copy_file("/nonexistent/file", dst.c_str()).err().unix_errno, ENOENT);
+}
+
+TEST_F(file_copy_test, every_method) {
+    const std::string src = temp_file(string_view{data});
+    common::fd_handle in{src.c_str()};
+    for (auto method : {common::copy_method::copy_file_range, common::copy_method::sendfile,
+                        common::copy_method::splice, common::copy_method::buffer}) {
+        const std::string dst = temp_file(string_view{""});
+        common::fd_handle out{dst.c_str(), O_WRONLY};
+        auto res = common::impl::transfer(out.fd(), in.fd(), 100, data.size(), method);
+        ASSERT_TRUE(res.is_ok());
+        EXPECT_EQ(res.res(), data.size() - 100);
+        EXPECT_EQ(read_file(dst), data.substr(100)) << int(method);
+    }
+}
+
+TEST_F(file_copy_test, send_file_to_pipe) {
+    const std::string src = temp_file(string_view{data});
+    common::file_handle in{src.c_str()};
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    common::fd_handle read_end{fds[0]};
+    std::string received;
+    std::thread reader([&] {
+        char buf[65536];
+        ssize_t got;
+        while ((got = ::read(fds[0], buf, sizeof(buf))) > 0)
+            received.append(buf, got);
+    });
+    auto res = common::send_file(fds[1], in, 10, 2000000);
+    ::close(fds[1]);
+    reader.join();
+    ASSERT_TRUE(res.is_ok());
+    EXPECT_EQ(res.res(), 2000000u);
+    EXPECT_EQ(received, data.substr(10, 2000000));
+}
+
+TEST_F(file_copy_test, send_file_append) {
+    // copy_file_range() and sendfile() both reject O_APPEND outputs
+    const std::string src = temp_file(string_view{"0123456789"});
+    const std::string dst = temp_file(string_view{"head:"});
+    common::fd_handle in{src.c_str()};
+    common::fd_handle out{dst.c_str(), O_WRONLY | O_APPEND};
+    EXPECT_EQ(common::send_file(out.fd(), in, 4, 100).res(), 6u);
+    EXPECT_EQ(read_file(dst), "head:456789");
+}
+
+TEST_F(file_copy_test, errors) {
+    common::fd_handle closed;
+    EXPECT_EQ(common::send_file(1, closed, 0, 10).err().unix_errno, ENOENT);
+    const std::string src = temp_file(string_view{"abc"});
+    common::fd_handle in{src.c_str()};
+    EXPECT_EQ(common::send_file(-1, in, 0, 3).err().unix_errno, EBADF);
+}
+
+TEST_F(file_copy_test, copy_onto_itself) {
+    const std::string src = temp_file(string_view{"precious"});
+    auto res = common::copy_file(src.c_str(), src.c_str());
+    ASSERT_TRUE(res.is_err());
+    EXPECT_EQ(res.err(), EINVAL);
+
+    const std::string link = src + ".link";
+    ASSERT_EQ(::link(src.c_str(), link.c_str()), 0);
+    names.push_back(link);
+    EXPECT_EQ(common::copy_file(src.c_str(), link.c_str()).err(), EINVAL);
+    EXPECT_EQ(read_file(src), "precious");
+}
+
+TEST_F(file_copy_test, copy_directory) {
+    const std::string dst = temp_file(string_view{"untouched"});
+    EXPECT_EQ(common::copy_file("/tmp", dst.c_str()).err(), EISDIR);
+    EXPECT_EQ(read_file(dst), "untouched");
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include "common/file_handle.hpp"
+#include "test_temp_file.hpp"
+
+using common::string_view;
+
+TEST(read_lines, straddling_buffer) {
+    std::string content;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 500; ++i) {
+        expected.push_back(std::string(i % 13, 'a' + i % 26));
+        content += expected.back() + "\n";
+    }
+    content += "unterminated";
+    expected.push_back("unterminated");
+    const std::string name = make_temp_file(content);
+
+    common::file_handle file{name.c_str()};
+    std::array<char, 16> buffer;
+    std::vector<std::string> res;
+    auto count = file.read_lines(common::make_array_view(buffer), [&] (string_view line) {
+        res.push_back(line.to_string());
+    });
+    ASSERT_TRUE(count.is_ok());
+    EXPECT_EQ(count.res(), expected.size());
+    EXPECT_EQ(res, expected);
+    ::unlink(name.c_str());
+}
+
+TEST(read_lines, record_too_long) {
+    const std::string name = make_temp_file("short\nthis line is much too long for the buffer\n");
+    common::file_handle file{name.c_str()};
+    std::array<char, 8> buffer;
+    size_t lines = 0;
+    auto count = file.read_lines(common::make_array_view(buffer), [&] (string_view) { lines += 1; });
+    ASSERT_TRUE(count.is_err());
+    EXPECT_EQ(count.err(), ENOBUFS);
+    EXPECT_EQ(lines, 1u);
+    ::unlink(name.c_str());
+}
+
+TEST(read_lines, record_fills_buffer) {
+    // Records of exactly the buffer size fit, terminated or at end of file
+    for (const char* content : {"12345678\nab\n12345678\n", "12345678\nab\n12345678"}) {
+        const std::string name = make_temp_file(content);
+        common::file_handle file{name.c_str()};
+        std::array<char, 8> buffer;
+        std::vector<std::string> lines;
+        auto count = file.read_lines(common::make_array_view(buffer), [&] (string_view line) {
+            lines.emplace_back(line.begin(), line.end());
+        });
+        ASSERT_TRUE(count.is_ok());
+        EXPECT_EQ(count.res(), 3u);
+        EXPECT_EQ(lines, (std::vector<std::string>{"12345678", "ab", "12345678"}));
+        ::unlink(name.c_str());
+    }
+    const std::string name = make_temp_file("123456789\n");
+    common::file_handle file{name.c_str()};
+    std::array<char, 8> buffer;
+    EXPECT_EQ(file.read_lines(common::make_array_view(buffer), [] (string_view) {}).err(), ENOBUFS);
+    ::unlink(name.c_str());
+}
+
+TEST(read_records, empty_file) {
+    const std::string name = make_temp_file("");
+    common::file_handle file{name.c_str()};
+    std::array<char, 8> buffer;
+    auto count = file.read_records(common::make_array_view(buffer), ',', [&] (string_view) {});
+    ASSERT_TRUE(count.is_ok());
+    EXPECT_EQ(count.res(), 0u);
+    ::unlink(name.c_str());
+}
+
+TEST(write_all, after_buffered_write) {
+    const std::string name = make_temp_file("");
+    {
+        common::file_handle file{name.c_str(), "w"};
+        ASSERT_TRUE(file.write(string_view{"buffered "}).is_ok());
+        const string_view header{"header:"}, key{"key="}, payload{"payload"};
+        const common::array_view<const char> parts[] = {header, key, payload};
+        ASSERT_TRUE(file.write_all(common::make_array_view(parts)).is_ok());
+        ASSERT_TRUE(file.write(string_view{" trailer"}).is_ok());
+    }
+    common::file_handle file{name.c_str()};
+    std::string content;
+    ASSERT_TRUE(file.read_all(content).is_ok());
+    EXPECT_EQ(content, "buffered header:key=payload trailer");
+    ::unlink(name.c_str());
+}
+
+TEST(advise, page_cache_hints) {
+    const std::string name = make_temp_file(std::string(1 << 20, 'x'));
+    common::file_handle file{name.c_str()};
+    EXPECT_TRUE(file.advise_sequential().is_ok());
+    EXPECT_TRUE(file.advise_random().is_ok());
+    EXPECT_TRUE(file.readahead(0, 1 << 20).is_ok());
+    EXPECT_TRUE(file.prefetch_async(4096, 8192).is_ok());
+    std::string content;
+    ASSERT_TRUE(file.read_all(content).is_ok());
+    EXPECT_EQ(content.size(), size_t(1 << 20));
+    EXPECT_TRUE(file.advise_dontneed().is_ok());
+    ::unlink(name.c_str());
+
+    common::file_handle closed;
+    EXPECT_EQ(closed.advise_sequential().err().unix_errno, ENOENT);
+    EXPECT_EQ(closed.readahead(0, 10).err().unix_errno, ENOENT);
+}
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include "common/log_writer.hpp"
+#include "common/mapped_file.hpp"
+#include "test_temp_file.hpp"
+
+using common::string_view;
+
+struct log_writer_test : ::testing::Test
+{
+    std::string name;
+
+    void SetUp() override
+    {
+        name = make_temp_file();
+    }
+    void TearDown() override
+    {
+        ::unlink(name.c_str());
+    }
+    std::vector<std::string> read_back(size_t* valid = nullptr)
+    {
+        common::mapped_file mapped;
+        EXPECT_TRUE(mapped.open(name.c_str()).is_ok());
+        std::vector<std::string> records;
+        const string_view content = mapped.view().res();
+        const size_t good = common::read_log_records(content, [&] (string_view rec) {
+            records.emplace_back(rec.begin(), rec.end());
+        });
+        if (valid)
+            *valid = good;
+        return records;
+    }
+};
+
+TEST_F(log_writer_test, append_and_read) {
+    {
+        common::log_writer log;
+        ASSERT_TRUE(log.open(name.c_str()).is_ok());
+        EXPECT_EQ(log.append(string_view{"first"}).res(), 0u);
+        EXPECT_EQ(log.append(string_view{""}).res(), 13u);
+        EXPECT_EQ(log.append(string_view{"third"}).res(), 21u);
+    }
+    {
+        common::log_writer log;
+        ASSERT_TRUE(log.open(name.c_str()).is_ok());
+        EXPECT_EQ(log.append(string_view{"reopened"}).res(), 34u);
+    }
+    size_t valid = 0;
+    EXPECT_EQ(read_back(&valid), (std::vector<std::string>{"first", "", "third", "reopened"}));
+    EXPECT_EQ(valid, 50u);
+}
+
+TEST_F(log_writer_test, torn_tail) {
+    {
+        common::log_writer log;
+        ASSERT_TRUE(log.open(name.c_str()).is_ok());
+        ASSERT_TRUE(log.append(string_view{"kept"}).is_ok());
+        ASSERT_TRUE(log.append(string_view{"torn record"}).is_ok());
+    }
+    ASSERT_EQ(::truncate(name.c_str(), 12 + 8 + 5), 0);
+    size_t valid = 0;
+    EXPECT_EQ(read_back(&valid), std::vector<std::string>{"kept"});
+    EXPECT_EQ(valid, 12u);
+
+    common::fd_handle file{name.c_str(), O_RDWR};
+    ASSERT_TRUE(file.write_at(string_view{"X"}, 9).is_ok());
+    EXPECT_EQ(read_back(&valid), std::vector<std::string>{});
+    EXPECT_EQ(valid, 0u);
+}
+
+TEST_F(log_writer_test, reopen_after_torn_tail) {
+    {
+        common::log_writer log;
+        ASSERT_TRUE(log.open(name.c_str()).is_ok());
+        ASSERT_TRUE(log.append(string_view{"kept"}).is_ok());
+        ASSERT_TRUE(log.append(string_view{"torn record"}).is_ok());
+    }
+    ASSERT_EQ(::truncate(name.c_str(), 12 + 8 + 5), 0);
+    {
+        common::log_writer log;
+        ASSERT_TRUE(log.open(name.c_str()).is_ok());
+        EXPECT_EQ(log.append(string_view{"after"}).res(), 12u);
+    }
+    size_t valid = 0;
+    EXPECT_EQ(read_back(&valid), (std::vector<std::string>{"kept", "after"}));
+    EXPECT_EQ(valid, 25u);
+    common::mapped_file mapped{name.c_str()};
+    EXPECT_EQ(mapped.size(), 25u);
+}
+
+TEST_F(log_writer_test, group_commit) {
+    const int threads = 8;
+    const int per_thread = 200;
+    common::log_writer::options opts;
+    opts.max_delay = std::chrono::microseconds{200};
+    opts.max_batch_bytes = 4096;
+
+    common::log_writer log;
+    ASSERT_TRUE(log.open(name.c_str(), opts).is_ok());
+    std::vector<std::thread> workers;
+    std::vector<std::set<uint64_t>> offsets(threads);
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < per_thread; ++i) {
+                const std::string rec = std::to_string(t) + ":" + std::to_string(i);
+                auto res = log.append(string_view{rec});
+                ASSERT_TRUE(res.is_ok());
+                offsets[t].insert(res.res());
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    EXPECT_LT(log.open_batch - 1, uint64_t(threads * per_thread));
+
+    const auto records = read_back();
+    ASSERT_EQ(records.size(), size_t(threads * per_thread));
+    std::vector<int> next(threads, 0);
+    for (const std::string& rec : records) {
+        const int t = std::stoi(rec);
+        EXPECT_EQ(rec, std::to_string(t) + ":" + std::to_string(next[t]));
+        ++next[t];
+    }
+    for (int t = 0; t < threads; ++t)
+        EXPECT_EQ(offsets[t].size(), size_t(per_thread));
+}
+
+TEST_F(log_writer_test, failure_after_committed_batch) {
+    const int threads = 8;
+    const int per_thread = 100;
+    common::log_writer log;
+    ASSERT_TRUE(log.open(name.c_str()).is_ok());
+
+    std::vector<std::thread> workers;
+    std::vector<std::vector<std::pair<std::string, bool>>> outcomes(threads);
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < per_thread; ++i) {
+                const std::string rec = std::to_string(t) + ":" + std::to_string(i);
+                outcomes[t].emplace_back(rec, log.append(string_view{rec}).is_ok());
+            }
+        });
+    }
+    // Break the descriptor once a few batches are durable: writes now fail with EBADF
+    for (bool broken = false; !broken; std::this_thread::yield()) {
+        std::lock_guard<std::mutex> guard(log.lock);
+        if (log.committed_batch >= 3) {
+            common::fd_handle read_only{name.c_str()};
+            EXPECT_GE(::dup2(read_only.fd(), log.file.fd()), 0);
+            broken = true;
+        }
+    }
+    for (auto& w : workers)
+        w.join();
+    EXPECT_NE(log.failed_batch, UINT64_MAX);
+
+    // A record is acknowledged exactly when it is durable
+    const auto records = read_back();
+    const std::set<std::string> durable(records.begin(), records.end());
+    for (const auto& thread_outcomes : outcomes) {
+        for (const auto& outcome : thread_outcomes)
+            EXPECT_EQ(durable.count(outcome.first) == 1, outcome.second) << outcome.first;
+    }
+}
+
+TEST_F(log_writer_test, closed) {
+    common::log_writer log;
+    auto res = log.append(string_view{"nowhere"});
+    ASSERT_FALSE(res.is_ok());
+    EXPECT_EQ(res.err().unix_errno, ENOENT);
+}
@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include "common/file_handle.hpp"
+#include "common/mapped_file.hpp"
+#include "test_temp_file.hpp"
+
+using common::string_view;
+
+TEST(mapped_file, read) {
+    const std::string name = make_temp_file("key=value\nother=thing\n");
+    common::mapped_file file;
+    ASSERT_TRUE(file.open(name.c_str()).is_ok());
+    EXPECT_TRUE(file.advise(common::mapped_file::advice::sequential).is_ok());
+    EXPECT_TRUE(file.advise(common::mapped_file::advice::willneed, 3, 5).is_ok());
+    ASSERT_TRUE(file.view().is_ok());
+    EXPECT_EQ(file.view().res(), "key=value\nother=thing\n");
+    ::unlink(name.c_str());
+}
+
+TEST(mapped_file, empty) {
+    const std::string name = make_temp_file("");
+    common::mapped_file file{name.c_str()};
+    EXPECT_TRUE(file.is_open());
+    EXPECT_EQ(file.view().res(), "");
+    EXPECT_TRUE(file.advise(common::mapped_file::advice::random).is_ok());
+    ::unlink(name.c_str());
+}
+
+TEST(mapped_file, missing) {
+    common::mapped_file file;
+    auto res = file.open("/nonexistent/common_cxx/file");
+    ASSERT_TRUE(res.is_err());
+    EXPECT_EQ(res.err(), ENOENT);
+    EXPECT_TRUE(file.view().is_err());
+}
+
+TEST(mapped_file, move) {
+    const std::string name = make_temp_file("contents");
+    common::mapped_file file{name.c_str()};
+    common::mapped_file other{std::move(file)};
+    EXPECT_FALSE(file.is_open());
+    EXPECT_EQ(other.view().res(), "contents");
+    ::unlink(name.c_str());
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "common/parallel_split.hpp"
+
+using common::string_view;
+
+static std::string make_lines(size_t count)
+{
+    std::string out;
+    for (size_t i = 0; i < count; ++i) {
+        out += std::to_string(i);
+        out += (i % 7) ? "\n" : "\n\n";
+    }
+    return out;
+}
+
+TEST(split_fn_parallel, ordered) {
+    const std::string content = make_lines(100000);
+    std::vector<string_view> expected;
+    string_view{content}.split_fn('\n', [&] (string_view line) { expected.push_back(line); });
+
+    auto chunks = common::split_fn_parallel<std::vector<string_view>>(string_view{content}, '\n', 8,
+        [] (std::vector<string_view>& lines, string_view line) { lines.push_back(line); }, 4096);
+    EXPECT_GT(chunks.size(), 1u);
+    EXPECT_LE(chunks.size(), 8u);
+
+    std::vector<string_view> res;
+    for (const auto& lines : chunks)
+        res.insert(res.end(), lines.begin(), lines.end());
+    EXPECT_EQ(res, expected);
+}
+
+TEST(split_fn_parallel, small_input) {
+    auto counts = common::split_fn_parallel<size_t>(string_view{"a\nb\nc"}, '\n', 4,
+        [] (size_t& count, string_view) { count += 1; });
+    ASSERT_EQ(counts.size(), 1u);
+    EXPECT_EQ(counts[0], 3u);
+}
+
+TEST(split_fn_parallel, empty) {
+    auto counts = common::split_fn_parallel<size_t>(string_view{""}, '\n', 4,
+        [] (size_t& count, string_view) { count += 1; });
+    ASSERT_EQ(counts.size(), 1u);
+    EXPECT_EQ(counts[0], 0u);
+}
+
+TEST(split_fn_parallel, exceptions) {
+    std::string content;
+    for (int i = 0; i < 4000; ++i)
+        content += std::to_string(i) + "\n";
+    // Throwing on a worker chunk and on the calling thread's chunk both propagate
+    for (const char* poison : {"3000", "0"}) {
+        EXPECT_THROW(common::split_fn_parallel<size_t>(string_view{content}, '\n', 4,
+            [poison] (size_t& count, string_view line) {
+                if (line == string_view{poison})
+                    throw std::runtime_error("bad line");
+                count += 1;
+            }, 1024), std::runtime_error);
+    }
+}
@@ -161,6 +161,65 @@ TEST(split_advanced, split_any) {
     EXPECT_EQ(final, "final");
 }
 
+TEST(split_advanced, split_any_long) {
+    std::string source;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 50; ++i) {
+        expected.push_back(std::string(i % 37, 'x') + std::to_string(i));
+        source += expected.back();
+        source += " \t\r\n,"[i % 5];
+    }
+    std::vector<std::string> res;
+    string_view{source}.split_fn(string_view::splitter::any_char(" \t\r\n,"), [&res] (string_view str) {
+        res.push_back(str.to_string());
+    });
+    EXPECT_EQ(res, expected);
+}
+
+TEST(split_advanced, split_any_large_set) {
+    string_view key, value;
+    string_view source{"the quick brown fox jumps over+the lazy dog"};
+    size_t count = source.split_args(string_view::splitter::any_char("0123456789ABCDEFGHIJ+"), key, value);
+    EXPECT_EQ(count, 2);
+    EXPECT_EQ(key, "the quick brown fox jumps over");
+    EXPECT_EQ(value, "the lazy dog");
+}
+
+TEST(split_advanced, string_pattern_long_input) {
+    std::string source;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 40; ++i) {
+        expected.push_back(std::string(i % 23, i % 2 ? '|' : ' ') + std::to_string(i));
+        source += expected.back() + " | ";
+    }
+    std::vector<std::string> res;
+    string_view{source}.split_fn(string_view::splitter::string(" | "), [&res] (string_view str) {
+        res.push_back(str.to_string());
+    });
+    EXPECT_EQ(res, expected);
+}
+
+TEST(find, reused_searcher) {
+    const auto crlf = string_view::splitter::string("\r\n");
+    string_view source{"a header line of some length\r\nanother line\r\n"};
+    EXPECT_EQ(source.find_opt(crlf).get_or(0), 28);
+    EXPECT_EQ(source.advance(30).find(crlf), 12);
+    EXPECT_EQ(source.advance(43).find(crlf), string_view::npos);
+    EXPECT_EQ(source.find("line\r\n"), 38);
+    EXPECT_EQ(source.find("not present"), string_view::npos);
+    EXPECT_EQ(string_view{"\r\n"}.find(crlf), 0);
+}
+
+TEST(find, periodic_needles) {
+    // Every position passes the first/last byte filter, for both the filtered and the memmem() lengths
+    for (size_t len : {size_t(8), size_t(32), size_t(33), size_t(200)}) {
+        const std::string needle = std::string(len - 1, 'a') + "b";
+        const std::string haystack = std::string(20000, 'a') + "b";
+        EXPECT_EQ(string_view{haystack}.find(string_view{needle}), haystack.size() - len) << len;
+        EXPECT_EQ(string_view{haystack}.head(20000).find(string_view{needle}), string_view::npos) << len;
+    }
+}
+
 TEST(basename, normal) {
     string_view source{"/some/path"};
     string_view basename = source.basename();
@@ -316,6 +375,164 @@ TEST(split_fn, normal) {
     EXPECT_EQ(res, expected);
 }
 
+TEST(index_of, resume) {
+    string_view source{"one\ntwo\n\nthree\nfour score and seven years ago our fathers\nbrought forth\n"};
+    std::array<uint32_t, 2> offsets;
+    std::vector<uint32_t> all;
+    size_t found = 0;
+    size_t from = 0;
+    while ((found = source.index_of('\n', common::make_array_view(offsets), from))) {
+        all.insert(all.end(), offsets.begin(), offsets.begin() + found);
+        from = offsets[found - 1] + 1;
+    }
+    std::vector<uint32_t> expected;
+    for (size_t i = 0; i < source.size(); ++i)
+        if (source[i] == '\n')
+            expected.push_back(i);
+    EXPECT_EQ(all, expected);
+}
+
+TEST(split_fn_indexed, matches_split_fn) {
+    std::string source;
+    unsigned seed = 7;
+    for (int i = 0; i < 2000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        source.append((seed >> 16) % 40, 'a' + i % 26);
+        source += '\n';
+    }
+    std::vector<string_view> expected;
+    size_t expected_count = string_view{source}.split_fn('\n', [&] (string_view line) { expected.push_back(line); });
+
+    std::vector<string_view> res;
+    std::array<uint64_t, 64> offsets64;
+    EXPECT_EQ(string_view{source}.split_fn_indexed('\n', common::make_array_view(offsets64), [&] (string_view line) { res.push_back(line); }), expected_count);
+    EXPECT_EQ(res, expected);
+
+    // Offsets narrower than the input are indexed in windows
+    res.clear();
+    std::array<uint8_t, 3> offsets8;
+    EXPECT_EQ(string_view{source}.split_fn_indexed('\n', common::make_array_view(offsets8), [&] (string_view line) { res.push_back(line); }), expected_count);
+    EXPECT_EQ(res, expected);
+}
+
+TEST(split_range, normal) {
+    std::vector<string_view> res;
+    for (string_view field : string_view{"key=value==trailing="}.split('='))
+        res.push_back(field);
+    std::vector<string_view> expected = {"key", "value", "", "trailing", ""};
+    EXPECT_EQ(res, expected);
+}
+
+TEST(split_range, skip_empty) {
+    std::vector<string_view> res;
+    for (string_view field : string_view{"==key=value==trailing=="}.split({'=', string_view::skip_empty}))
+        res.push_back(field);
+    std::vector<string_view> expected = {"key", "value", "trailing"};
+    EXPECT_EQ(res, expected);
+}
+
+TEST(split_range, early_break) {
+    string_view source{"a, b,c, d"};
+    auto fields = source.split(string_view::splitter::string(", "));
+    auto it = fields.begin();
+    EXPECT_EQ(*it, "a");
+    ++it;
+    EXPECT_EQ(*it, "b,c");
+    EXPECT_EQ(it.rest(), "d");
+    ++it;
+    EXPECT_EQ(*it, "d");
+    ++it;
+    EXPECT_EQ(it, fields.end());
+}
+
+TEST(split_range, last_captures_all) {
+    std::vector<string_view> res;
+    string_view source{"GET  /index.html HTTP/1.1"};
+    for (string_view field : source.split(string_view::splitter::any_char(" ", string_view::split_flag(string_view::skip_empty | string_view::last_captures_all)), 2))
+        res.push_back(field);
+    std::vector<string_view> expected = {"GET", "/index.html HTTP/1.1"};
+    EXPECT_EQ(res, expected);
+}
+
+TEST(split_range, empty) {
+    size_t count = 0;
+    for (string_view field : string_view{""}.split(',')) {
+        EXPECT_EQ(field, "");
+        count += 1;
+    }
+    EXPECT_EQ(count, 1);
+    for (string_view field : string_view{",,"}.split({',', string_view::skip_empty}))
+        ADD_FAILURE() << "unexpected token " << field.to_string();
+}
+
+TEST(parse, integers) {
+    EXPECT_EQ(string_view{"0"}.parse<int>().res(), 0);
+    EXPECT_EQ(string_view{"12345"}.parse<int>().res(), 12345);
+    EXPECT_EQ(string_view{"-12345"}.parse<int>().res(), -12345);
+    EXPECT_EQ(string_view{"0001234567890123"}.parse<int64_t>().res(), 1234567890123);
+    EXPECT_EQ(string_view{"18446744073709551615"}.parse<uint64_t>().res(), std::numeric_limits<uint64_t>::max());
+    EXPECT_EQ(string_view{"-9223372036854775808"}.parse<int64_t>().res(), std::numeric_limits<int64_t>::min());
+    EXPECT_EQ(string_view{"255"}.parse<uint8_t>().res(), 255);
+    EXPECT_EQ(string_view{"-128"}.parse<int8_t>().res(), -128);
+}
+
+TEST(parse, integer_errors) {
+    EXPECT_EQ(string_view{""}.parse<int>().err(), common::parse_error::empty);
+    EXPECT_EQ(string_view{"-"}.parse<int>().err(), common::parse_error::invalid);
+    EXPECT_EQ(string_view{"+1"}.parse<int>().err(), common::parse_error::invalid);
+    EXPECT_EQ(string_view{" 1"}.parse<int>().err(), common::parse_error::invalid);
+    EXPECT_EQ(string_view{"12345678x"}.parse<int>().err(), common::parse_error::invalid);
+    EXPECT_EQ(string_view{"-1"}.parse<unsigned>().err(), common::parse_error::invalid);
+    EXPECT_EQ(string_view{"256"}.parse<uint8_t>().err(), common::parse_error::out_of_range);
+    EXPECT_EQ(string_view{"18446744073709551616"}.parse<uint64_t>().err(), common::parse_error::out_of_range);
+    EXPECT_EQ(string_view{"9223372036854775808"}.parse<int64_t>().err(), common::parse_error::out_of_range);
+    EXPECT_EQ(string_view{"123456789012345678901"}.parse<uint64_t>().err(), common::parse_error::out_of_range);
+}
+
+TEST(parse, floats) {
+    EXPECT_EQ(string_view{"0"}.parse<double>().res(), 0.0);
+    EXPECT_EQ(string_view{"1.5"}.parse<double>().res(), 1.5);
+    EXPECT_EQ(string_view{"-0.001"}.parse<double>().res(), -0.001);
+    EXPECT_EQ(string_view{".25"}.parse<double>().res(), 0.25);
+    EXPECT_EQ(string_view{"3.14159265358979"}.parse<double>().res(), 3.14159265358979);
+    EXPECT_EQ(string_view{"1e10"}.parse<double>().res(), 1e10);
+    EXPECT_EQ(string_view{"6.02214076E+23"}.parse<double>().res(), 6.02214076e23);
+    EXPECT_EQ(string_view{"0.1000000000000000055511151231257827"}.parse<double>().res(), 0.1);
+    EXPECT_EQ(string_view{"2.5e-3"}.parse<float>().res(), 2.5e-3f);
+    EXPECT_EQ(string_view{"123456.789"}.parse<float>().res(), 123456.789f);
+    EXPECT_EQ(string_view{""}.parse<double>().err(), common::parse_error::empty);
+    EXPECT_EQ(string_view{"1.5x"}.parse<double>().err(), common::parse_error::invalid);
+    EXPECT_EQ(string_view{"e5"}.parse<double>().err(), common::parse_error::invalid);
+    EXPECT_EQ(string_view{"1e999"}.parse<double>().err(), common::parse_error::out_of_range);
+}
+
+TEST(parse, float_ranges) {
+    // Subnormals parse, underflow to zero and overflow are out_of_range, in every build
+    EXPECT_EQ(string_view{"4.9e-324"}.parse<double>().res(), 4.9e-324);
+    EXPECT_EQ(string_view{"1e-310"}.parse<double>().res(), 1e-310);
+    EXPECT_EQ(string_view{"1e-400"}.parse<double>().err(), common::parse_error::out_of_range);
+    EXPECT_EQ(string_view{"1e-45"}.parse<float>().res(), 1e-45f);
+    EXPECT_EQ(string_view{"1e-46"}.parse<float>().err(), common::parse_error::out_of_range);
+    EXPECT_EQ(string_view{"1e39"}.parse<float>().err(), common::parse_error::out_of_range);
+    EXPECT_EQ(string_view{"0e999999999999"}.parse<double>().res(), 0.0);
+    EXPECT_EQ(string_view{"1e99999999999"}.parse<double>().err(), common::parse_error::out_of_range);
+    EXPECT_EQ(string_view{"1e99999999999x"}.parse<double>().err(), common::parse_error::invalid);
+}
+
+TEST(parse, long_floats) {
+    const std::string tiny = "0." + std::string(300, '0') + "1";
+    EXPECT_EQ(string_view{tiny}.parse<double>().res(), 1e-301);
+    const std::string one = "1" + std::string(200, '0') + "e-200";
+    EXPECT_EQ(string_view{one}.parse<double>().res(), 1.0);
+    const std::string huge = "-1" + std::string(400, '0');
+    EXPECT_EQ(string_view{huge}.parse<double>().err(), common::parse_error::out_of_range);
+    // 2^53 + 1 is a tie that rounds to even, unless a far-off digit tips it up
+    const std::string tie = "9007199254740993." + std::string(900, '0');
+    EXPECT_EQ(string_view{tie}.parse<double>().res(), 9007199254740992.0);
+    EXPECT_EQ(string_view{tie + "1"}.parse<double>().res(), 9007199254740994.0);
+    EXPECT_EQ(string_view{tie + "1x"}.parse<double>().err(), common::parse_error::invalid);
+}
+
 TEST(compare, less_than) {
     string_view a{"a"}, b{"b"};
     EXPECT_EQ(a < b, true);
@@ -0,0 +1,33 @@
+#ifndef COMMON_TEST_TEMP_FILE_HPP
+#define COMMON_TEST_TEMP_FILE_HPP
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string>
+#include "common/fd_handle.hpp"
+#include "common/string_view.hpp"
+
+/// Create a file under /tmp holding content and return its name; the
+/// caller unlinks it
+inline std::string make_temp_file(common::string_view content = common::string_view{})
+{
+    char name[] = "/tmp/common_cxx_test_XXXXXX";
+    const int fd = ::mkstemp(name);
+    EXPECT_GE(fd, 0);
+    common::fd_handle file{fd};
+    if (content.size()) {
+        EXPECT_TRUE(file.write(content).is_ok());
+    }
+    return name;
+}
+
+/// Create an empty directory under /tmp and return its name; the caller
+/// removes it
+inline std::string make_temp_dir()
+{
+    char name[] = "/tmp/common_cxx_test_XXXXXX";
+    EXPECT_NE(::mkdtemp(name), nullptr);
+    return name;
+}
+
+#endif // COMMON_TEST_TEMP_FILE_HPP
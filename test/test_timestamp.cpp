@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "common/common_timestamp.hpp"
+#include "common/common_timestamp_fmt.hpp"
 
 TEST(system, now) {
     common::timestamp now = common::timestamp::now();
@@ -7,3 +8,153 @@ TEST(system, now) {
     EXPECT_GT(now, year2021);
 }
 
+
+TEST(system, clocks) {
+    const common::timestamp now = common::timestamp::now();
+    const common::timestamp coarse = common::timestamp::coarse_now();
+    // Coarse clocks lag by at most a few scheduler ticks
+    EXPECT_LT(std::abs((now - coarse).to_millis()), 100);
+
+    const common::timestamp mono = common::timestamp::monotonic_now();
+    const common::timestamp mono_coarse = common::timestamp::monotonic_coarse_now();
+    EXPECT_LT(std::abs((mono - mono_coarse).to_millis()), 100);
+    EXPECT_LT(mono, now);
+    EXPECT_GE(common::timestamp::monotonic_now(), mono);
+    EXPECT_GE(common::timestamp::monotonic_coarse_now(), mono_coarse);
+
+    const common::timestamp steady = common::timestamp::steady_now();
+    EXPECT_GE(common::timestamp::steady_now(), steady);
+}
+
+TEST(duration, arithmetic) {
+    using common::duration;
+    using common::timestamp;
+    static_assert(duration::milliseconds(1500).to_seconds() == 1, "");
+    static_assert(duration::seconds(2) - duration::microseconds(1) == duration{1999999000}, "");
+    static_assert(duration{std::chrono::milliseconds(3)} == duration::microseconds(3000), "");
+    static_assert(timestamp{10, 5} - timestamp{9, 999999999} == duration{6}, "");
+    static_assert(timestamp{9, 999999999} - timestamp{10, 5} == duration{-6}, "");
+    static_assert(timestamp{9, 999999999} + duration{6} == timestamp{10, 5}, "");
+    static_assert(timestamp{10, 5} - duration::seconds(1) == timestamp{9, 5}, "");
+    static_assert(timestamp{12, 500000000}.seconds_since(timestamp{10, 0}) == 2.5, "");
+    static_assert(timestamp{10, 0}.seconds_since(timestamp{12, 500000000}) == -2.5, "");
+
+    // Nanosecond resolution survives at epoch scale, where a double does not
+    const timestamp a{1700000000, 123456789};
+    const timestamp b{1700000000, 123456790};
+    EXPECT_EQ((b - a).to_nanos(), 1);
+    EXPECT_EQ(a + (b - a), b);
+    EXPECT_EQ(b.minus_seconds(0.5), (timestamp{1699999999, 623456790}));
+
+    duration total;
+    total += duration::milliseconds(250);
+    total -= duration::milliseconds(50);
+    EXPECT_EQ(total * 5, duration::seconds(1));
+    EXPECT_EQ(duration::seconds(1) / total, 5);
+    EXPECT_EQ(total.to_chrono(), std::chrono::milliseconds(200));
+    EXPECT_DOUBLE_EQ(double(total), 0.2);
+
+    timestamp t{5, 0};
+    t += std::chrono::seconds(2);
+    EXPECT_EQ(t, (timestamp{7, 0}));
+    EXPECT_EQ((timestamp{1, 600000000} + timestamp{2, 700000000}), (timestamp{4, 300000000}));
+}
+
+TEST(timestamp_ns, conversion) {
+    using common::timestamp;
+    using common::timestamp_ns;
+    static_assert(timestamp_ns{timestamp{3, 7}}.ns == 3000000007, "");
+    static_assert(timestamp_ns{3000000007}.to_timestamp() == timestamp{3, 7}, "");
+    static_assert(timestamp_ns{timestamp{2, 0}} - timestamp_ns{timestamp{1, 5}} == common::duration{999999995}, "");
+
+    for (timestamp t : {timestamp::zero(), timestamp{1700000000, 999999999}, timestamp::max_value()})
+        EXPECT_EQ(timestamp_ns{t}.to_timestamp(), t);
+    EXPECT_LT(timestamp_ns(timestamp(1, 999999999)), timestamp_ns(timestamp(2, 0)));
+    EXPECT_EQ(timestamp_ns(timestamp(5, 0)) + common::duration::milliseconds(1), timestamp_ns(timestamp(5, 1000000)));
+}
+
+TEST(timestamp_ns, bulk) {
+    std::vector<common::timestamp> stamps;
+    for (uint32_t i = 0; i < 1000; ++i)
+        stamps.push_back(common::timestamp{1700000000 + i * 7919 % 1000, i * 104729 % 1000000000});
+    std::vector<common::timestamp_ns> packed(stamps.size() + 5);
+    EXPECT_EQ(common::pack_timestamps(stamps, packed), stamps.size());
+    for (size_t i = 0; i < stamps.size(); ++i)
+        EXPECT_EQ(packed[i].ns, int64_t(stamps[i].to_nanos()));
+
+    std::sort(packed.begin(), packed.begin() + stamps.size());
+    std::sort(stamps.begin(), stamps.end());
+    std::vector<common::timestamp> unpacked(stamps.size());
+    EXPECT_EQ(common::unpack_timestamps(common::make_array_view(packed.data(), stamps.size()), unpacked), stamps.size());
+    EXPECT_EQ(unpacked, stamps);
+}
+
+TEST(timestamp_fmt, iso8601) {
+    std::array<char, 40> buf;
+    const auto to = common::make_array_view(buf);
+    EXPECT_EQ(common::timestamp_fmt_iso8601_str(to, common::timestamp{0, 0}), "1970-01-01T00:00:00.000000000Z");
+    EXPECT_EQ(common::timestamp_fmt_iso8601_str(to, common::timestamp{951782400, 7}), "2000-02-29T00:00:00.000000007Z");
+    EXPECT_EQ(common::timestamp_fmt_iso8601_str(to, common::timestamp{1700000000, 123456789}), "2023-11-14T22:13:20.123456789Z");
+    // Consecutive stamps within one second reuse the cached prefix
+    EXPECT_EQ(common::timestamp_fmt_iso8601_str(to, common::timestamp{1700000000, 999999999}), "2023-11-14T22:13:20.999999999Z");
+    EXPECT_EQ(common::timestamp_fmt_iso8601_str(to, common::timestamp::max_value()), "2106-02-07T06:28:15.999999999Z");
+
+    std::array<char, 29> small;
+    EXPECT_EQ(common::timestamp_fmt_iso8601(common::make_array_view(small), common::timestamp{}), 0u);
+}
+
+TEST(timestamp_fmt, iso8601_matches_strftime) {
+    std::array<char, 40> buf, expected;
+    uint32_t secs = 12345;
+    for (int i = 0; i < 100000; ++i) {
+        secs = secs * 1664525u + 1013904223u;
+        const common::timestamp stamp{secs, secs % 1000000000u};
+        const auto date = common::timestamp_fmt_str(common::make_array_view(expected), "%Y-%m-%dT%H:%M:%S", stamp);
+        const auto full = common::timestamp_fmt_iso8601_str(common::make_array_view(buf), stamp);
+        ASSERT_EQ(full.head(19), date) << secs;
+        ASSERT_EQ(std::stoul(std::string(full.begin() + 20, full.begin() + 29)), stamp.nsecs);
+    }
+}
+
+TEST(timestamp_parse, rfc3339) {
+    using common::timestamp;
+    EXPECT_EQ(common::parse_timestamp("1970-01-01T00:00:00Z").res(), (timestamp{0, 0}));
+    EXPECT_EQ(common::parse_timestamp("2023-11-14T22:13:20.123456789Z").res(), (timestamp{1700000000, 123456789}));
+    EXPECT_EQ(common::parse_timestamp("2023-11-14t22:13:20.5z").res(), (timestamp{1700000000, 500000000}));
+    EXPECT_EQ(common::parse_timestamp("2023-11-14 22:13:20.000001Z").res(), (timestamp{1700000000, 1000}));
+    // Digits past nanoseconds are truncated
+    EXPECT_EQ(common::parse_timestamp("2023-11-14T22:13:20.1234567891234Z").res(), (timestamp{1700000000, 123456789}));
+    EXPECT_EQ(common::parse_timestamp("2023-11-15T00:13:20+02:00").res(), (timestamp{1700000000, 0}));
+    EXPECT_EQ(common::parse_timestamp("2023-11-14T17:43:20.25-04:30").res(), (timestamp{1700000000, 250000000}));
+    EXPECT_EQ(common::parse_timestamp("2000-02-29T00:00:00Z").res(), (timestamp{951782400, 0}));
+    EXPECT_EQ(common::parse_timestamp("2016-12-31T23:59:60Z").res(), (timestamp{1483228800, 0}));
+    EXPECT_EQ(common::parse_timestamp("2106-02-07T06:28:15.999999999Z").res(), timestamp::max_value());
+}
+
+TEST(timestamp_parse, errors) {
+    using common::parse_error;
+    EXPECT_EQ(common::parse_timestamp("").err(), parse_error::empty);
+    for (const char* bad : {"2023-11-14T22:13:20", "2023-11-14T22:13:20.Z", "2023-11-14T22:13:20ZZ",
+                            "2023-11-14X22:13:20Z", "2023-11-14T22-13:20Z", "2023/11/14T22:13:20Z",
+                            "2O23-11-14T22:13:20Z", "2023-11-14T22:13:2OZ", "2023-13-14T22:13:20Z",
+                            "2023-02-29T22:13:20Z", "1900-02-29T00:00:00Z", "2023-11-00T22:13:20Z",
+                            "2023-11-14T24:00:00Z", "2023-11-14T22:60:20Z", "2023-11-14T22:13:61Z",
+                            "2023-11-14T22:13:20+2:00", "2023-11-14T22:13:20+02:60", "2023-11-14T22:13:20+0200",
+                            " 2023-11-14T22:13:20Z"}) {
+        EXPECT_EQ(common::parse_timestamp(bad).err(), parse_error::invalid) << bad;
+    }
+    EXPECT_EQ(common::parse_timestamp("1969-12-31T23:59:59Z").err(), parse_error::out_of_range);
+    EXPECT_EQ(common::parse_timestamp("1970-01-01T00:00:00+00:01").err(), parse_error::out_of_range);
+    EXPECT_EQ(common::parse_timestamp("2106-02-07T06:28:16Z").err(), parse_error::out_of_range);
+}
+
+TEST(timestamp_parse, round_trip) {
+    std::array<char, 40> buf;
+    uint32_t secs = 987;
+    for (int i = 0; i < 100000; ++i) {
+        secs = secs * 1664525u + 1013904223u;
+        const common::timestamp stamp{secs, (secs * 7u) % 1000000000u};
+        const auto text = common::timestamp_fmt_iso8601_str(common::make_array_view(buf), stamp);
+        ASSERT_EQ(common::parse_timestamp(text).res(), stamp) << std::string(text.begin(), text.end());
+    }
+}
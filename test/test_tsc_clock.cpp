@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include "common/tsc_clock.hpp"
+
+static int64_t monotonic_ns()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * common::timestamp::SEC_NS + ts.tv_nsec;
+}
+
+TEST(tsc_clock, ordering) {
+    const common::tsc_stamp first = common::tsc_clock::now();
+    const common::tsc_stamp second = common::tsc_clock::now();
+    EXPECT_LE(first.ticks, second.ticks);
+    EXPECT_LE(first.to_monotonic(), second.to_monotonic());
+    EXPECT_GT(common::tsc_clock::global().ticks_per_second(), 1e6);
+}
+
+TEST(tsc_clock, matches_system_clocks) {
+    const common::timestamp wall = common::tsc_clock::now().to_timestamp();
+    EXPECT_LT(std::abs((wall - common::timestamp::now()).to_micros()), 1000);
+    const common::timestamp mono = common::tsc_clock::now().to_monotonic();
+    EXPECT_LT(std::abs((mono - common::timestamp::monotonic_now()).to_micros()), 1000);
+}
+
+TEST(tsc_clock, drift) {
+    // Over a few recalibration intervals, conversions stay close to CLOCK_MONOTONIC
+    common::tsc_clock clock{std::chrono::milliseconds(20)};
+    clock.recalibrate_after = std::chrono::milliseconds(50);
+    clock.try_recalibrate();
+    int64_t worst = 0;
+    for (int i = 0; i < 30; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const int64_t before = monotonic_ns();
+        const int64_t converted = clock.to_monotonic_ns(common::tsc_clock::ticks());
+        const int64_t after = monotonic_ns();
+        const int64_t error = std::max(before - converted, converted - after);
+        worst = std::max(worst, error);
+    }
+    EXPECT_LT(worst, 100 * 1000) << worst << " ns";
+}
+
+TEST(tsc_clock, fixed_point) {
+    // A 2.5 ns tick applied to deltas beyond 32 bits
+    const uint64_t rate = common::impl::div_q32(5, 2);
+    EXPECT_EQ(rate, uint64_t(5) << 31);
+    EXPECT_EQ(common::impl::mul_q32(int64_t(1) << 40, rate), int64_t(5) << 39);
+    EXPECT_EQ(common::impl::mul_q32(-(int64_t(1) << 40), rate), -(int64_t(5) << 39));
+    EXPECT_EQ(common::impl::div_q32(uint64_t(3) << 40, uint64_t(1) << 40), uint64_t(3) << 32);
+}